@@ -1,6 +1,33 @@
 ﻿#include <SFML/Graphics.hpp>
 #include <iostream>
 #include <math.h>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+#include <functional>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <SFML/OpenGL.hpp>
 
 
@@ -21,8 +48,8 @@ const double e = 2.718281828;
 // Гравитационная постоянная, м3/(кг*с2)
 const double G = 6.6743015 * pow(10, -11);
 
-// Молярная масса воздуха, г/моль
-const double Mv = 28.98;
+// Молярная масса воздуха, кг/моль
+const double Mv = 0.02898;
 
 // Универсальная газовая постоянная, Дж/(моль/К)
 const double R = 8.314;
@@ -30,349 +57,302 @@ const double R = 8.314;
 // Давление воздуха на уровне моря, Па
 const double Pvm = 101325;
 
+// Скорость вращения поверхности Земли на экваторе, м/с
+const double Vrot = 286.487;
+
 // Температура воздуха на данной высоте, К
 const double Tvm[2][29] = {
     { 0, 500, 1000, 1500,  2000, 2500, 3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000, 11000, 12000, 14000, 16000, 18000, 20000, 24000, 28000, 32000, 36000, 40000, 50000, 60000, 80000, 100000 },
     { 288.2, 284.9, 281.7, 278.4, 275.2, 271.9, 268.7, 262.2, 255.7, 249.2, 242.7, 236.2, 229.7, 223.3, 216.8, 216.7, 216.7, 216.7, 216.7, 216.7, 220.6, 224.5, 228.5, 239.3, 250.4, 270.7, 247, 198.6, 196.6}
 };
-double TVm = Tvm[1][0];
 
 // Плотность воздуха на уровне моря, кг/м3
-const double  rvm = Pvm * Mv / R / TVm;
+const double  rvm = Pvm * Mv / R / Tvm[1][0];
 
 // Структура характеристик ступеней РН //
 struct Stage {
 
     // Сухая масса ступени, кг
-    double Ms;
+    double Ms = 0;
 
     // Полная масса ступени, кг
-    double M;
+    double M = 0;
 
     // Масса топлива ступени, кг
-    double Mt = Ms - M;
+    double Mt = 0;
 
     // Тяга ступени на уровне моря, кН
-    double Tm;
+    double Tm = 0;
 
     // Тяга ступени в пустоте, кН
-    double Tp;
+    double Tp = 0;
 
     // Удельный импульс ступени на уровне моря, м/с
-    double Im;
+    double Im = 0;
 
     // Удельный импульс ступени в пустоте, м/с
-    double Ip;
+    double Ip = 0;
+
+    // Пределы множителя тяги; при Kmax = 0 не ограничен
+    double Kmin = 0;
+    double Kmax = 0;
+
+    // Площадь миделя РН при работе ступени, м2
+    double S = 0;
+
+    // Коэффициент лобового сопротивления Cd по числу Маха Ma
+    double Ma[9] = { 0, 0.5, 0.8, 1, 1.2, 1.5, 2, 3, 5 };
+    double Cd[9] = { 0.3, 0.3, 0.35, 0.55, 0.6, 0.5, 0.4, 0.3, 0.25 };
+
+    // Коэффициент лобового сопротивления при числе Маха m
+    double cd(double m) const;
 };
 
-// Структура планет и Солнца //
-struct Planet {
+// Таблица атмосферы Земли по высоте с шагом dh //
+struct Atmosphere {
+
+    // Шаг таблицы по высоте, м
+    double dh = 10;
 
-    // Масса объекта, кг
-    double M;
+    // Давление, Па, плотность, кг/м3, доля плотности уровня моря
+    // и скорость звука, м/с, на узлах таблицы
+    std::vector<double> P, rho, f, a;
 
-    // Перигелий орбиты, м
-    double Rp;
+    // Заполнение таблицы до 100 км или до высоты, где доля плотности
+    // меньше 1e-16 и тяга не отличается от тяги в пустоте
+    void build(double GM, double Re);
+
+    // Значения на высоте h линейной интерполяцией между узлами, выше таблицы — пустота
+    void at(double h, double& P, double& rho, double& f, double& a) const;
+};
 
-    // Афелий орбиты, м
-    double Ra;
+// Индексы тел в таблице, совпадают с номерами слежения P //
+enum { SUN, MERCURY, VENUS, EARTH, MARS, JUPITER, SATURN, URAN, NEPTUNE, LUNA, ROCKET };
 
-    // Радиус объекта, м
-    double R;
+// Модели тяготения: по маскам притяжения, все пары тел, дерево Барнса — Хата //
+enum { GRAV_MASK, GRAV_PAIR, GRAV_TREE };
 
-    // Проекция скорости на ось X, м/с
-    double Vx;
+// Схемы интегрирования: полунеявный Эйлер, чехарда, Иошида 4-го порядка, РК4, РКФ45,
+// чехарда с блочными шагами //
+enum { INT_EULER, INT_LEAP, INT_YOSHIDA, INT_RK4, INT_RKF45, INT_BLOCK };
 
-    // Проекция скорости на ось Y, м/с
-    double Vy;
+// Таблица тел в виде структуры массивов //
+struct Bodies {
 
-    // Координата X объекта, м
-    double x;
+    // Число тел
+    int n = 0;
 
-    // Координата Y объекта, м
-    double y;
+    // Массы объектов, кг
+    std::vector<double> M;
 
-    // Проекции ускорения на оси X и Y, м/с
-    double ax;
-    double ay;
+    // Радиусы объектов, м
+    std::vector<double> R;
 
-    // Ускорение свободного падения от Солнца, м/с2
-    double gs;
+    // Координаты объектов, м
+    std::vector<double> x, y;
 
-    // Ускорение свободного падения от планеты (для спутников), м/с2
-    double gp;
+    // Проекции скоростей, м/с
+    std::vector<double> Vx, Vy;
 
-    // Ускорение свободного падения от Луны (для РН), м/с2
-    double gl;
+    // Проекции ускорений, м/с2
+    std::vector<double> ax, ay;
 
-    // Угол относительно Солнца, рад
-    double phis;
+    // Маски притягивающих тел: бит j означает, что тело j притягивает данное
+    std::vector<unsigned> mk;
 
-    // Угол отосительно планеты (для спутников), рад
-    double phip;
+    // Цвета объектов при отрисовке
+    std::vector<Color> C;
 
-    // Угол отосительно Луны (для РН), рад
-    double phil;
+    // Добавление тела, возвращает его индекс
+    int add(double M, double R, double x, double y, double Vx, double Vy, unsigned mk, Color C);
 };
 
-double norm(double x, double y);
-double dot(double x, double y, double Z[]);
-double clamp(double value, double min, double max);
+// Метка и версия формата файла кэша состояний тел
+const char ephemTag[8] = "LUNAEPH";
+const uint32_t ephemVer = 1;
 
-RenderWindow window(VideoMode(width, height), "Luna");
+// Заголовок файла кэша состояний тел, числа в порядке байтов машины //
+struct EphemHeader {
 
-int main() {
+    // Метка файла и версия формата
+    char tag[8];
+    uint32_t ver;
 
-    // Данные Солнца //
+    // Число тел в кэше: первые тела таблицы
+    uint32_t nb;
 
-    Planet Sun;
-
-    Sun.M = 1.9885 * pow(10, 30);
-    Sun.R = 6.9551 * pow(10, 8);
-    Sun.x = 0;
-    Sun.y = 0;
-
-    // Данные Земли //
-
-    Planet Earth;
-
-    Earth.M = 5.9726 * pow(10, 24);
-    Earth.R = 6.371 * pow(10, 6);
-    Earth.Rp = 1.4709829 * pow(10, 11);
-    Earth.Ra = 1.52098232 * pow(10, 11);
-    Earth.Vx = 2.9783 * pow(10, 4);
-    Earth.Vy = 0;
-    Earth.x = Sun.x;
-    Earth.y = Sun.y + Earth.Rp;
-    Earth.ax = 0;
-    Earth.ay = 0;
-    Earth.gs = 0;
-    Earth.phis = 0;
-
-    // Данные Луны //
-
-    Planet Luna;
-
-    Luna.M = 7.3477 * pow(10, 22);
-    Luna.R = 1.7971 * pow(10, 6);
-    Luna.Rp = 3.63104 * pow(10, 8);
-    Luna.Ra = 4.05696 * pow(10, 8);
-    Luna.Vx = Earth.Vx + 1.023 * pow(10, 3);
-    Luna.Vy = Earth.Vy;
-    Luna.x = Earth.x;
-    Luna.y = Earth.y + Luna.Rp;
-    Luna.ax = 0;
-    Luna.ay = 0;
-    Luna.gs = 0;
-    Luna.gp = 0;
-    Luna.phis = 0;
-    Luna.phip = 0;
-
-    // Данные Меркурия //
-
-    Planet Mercury;
-
-    Mercury.M = 3.33022 * pow(10, 23);
-    Mercury.R = 2.4397 * pow(10, 6);
-    Mercury.Rp = 4.6001009 * pow(10, 10);
-    Mercury.Ra = 6.9817445 * pow(10, 10);
-    Mercury.Vx = 4.736 * pow(10, 4);
-    Mercury.Vy = 0;
-    Mercury.x = Sun.x;
-    Mercury.y = Sun.y + Mercury.Rp;
-    Mercury.ax = 0;
-    Mercury.ay = 0;
-    Mercury.gs = 0;
-    Mercury.phis = 0;
-
-    // Данные Венеры //
-
-    Planet Venus;
-
-    Venus.M = 4.8675 * pow(10, 24);
-    Venus.R = 6.0518 * pow(10, 6);
-    Venus.Rp = 1.07476259 * pow(10, 11);
-    Venus.Ra = 1.08942109 * pow(10, 11);
-    Venus.Vx = 3.502 * pow(10, 4);
-    Venus.Vy = 0;
-    Venus.x = Sun.x;
-    Venus.y = Sun.y + Venus.Rp;
-    Venus.ax = 0;
-    Venus.ay = 0;
-    Venus.gs = 0;
-    Venus.phis = 0;
-
-    // Данные Марса //
-
-    Planet Mars;
-
-    Mars.M = 6.4171 * pow(10, 23);
-    Mars.R = 3.3895 * pow(10, 6);
-    Mars.Rp = 2.06655 * pow(10, 11);
-    Mars.Ra = 2.49232 * pow(10, 11);
-    Mars.Vx = 2.4077 * pow(10, 4);
-    Mars.Vy = 0;
-    Mars.x = Sun.x;
-    Mars.y = Sun.y + Mars.Rp;
-    Mars.ax = 0;
-    Mars.ay = 0;
-    Mars.gs = 0;
-    Mars.phis = 0;
-
-    // Данные Юпитера //
-
-    Planet Jupiter;
-
-    Jupiter.M = 1.8986 * pow(10, 27);
-    Jupiter.R = 6.9911 * pow(10, 7);
-    Jupiter.Rp = 7.405736 * pow(10, 11);
-    Jupiter.Ra = 8.165208 * pow(10, 11);
-    Jupiter.Vx = 1.307 * pow(10, 4);
-    Jupiter.Vy = 0;
-    Jupiter.x = Sun.x;
-    Jupiter.y = Sun.y + Jupiter.Rp;
-    Jupiter.ax = 0;
-    Jupiter.ay = 0;
-    Jupiter.gs = 0;
-    Jupiter.phis = 0;
-
-    // Данные Сатурна //
-
-    Planet Saturn;
-
-    Saturn.M = 5.6846 * pow(10, 26);
-    Saturn.R = 5.8232 * pow(10, 7);
-    Saturn.Rp = 1.353572956 * pow(10, 12);
-    Saturn.Ra = 1.513325783 * pow(10, 12);
-    Saturn.Vx = 9.69 * pow(10, 3);
-    Saturn.Vy = 0;
-    Saturn.x = Sun.x;
-    Saturn.y = Sun.y + Saturn.Rp;
-    Saturn.ax = 0;
-    Saturn.ay = 0;
-    Saturn.gs = 0;
-    Saturn.phis = 0;
-
-    // Данные Урана //
-
-    Planet Uran;
-
-    Uran.M = 8.6813 * pow(10, 25);
-    Uran.R = 2.5362 * pow(10, 7);
-    Uran.Rp = 2.748938461 * pow(10, 12);
-    Uran.Ra = 3.004419704 * pow(10, 12);
-    Uran.Vx = 6.81 * pow(10, 3);
-    Uran.Vy = 0;
-    Uran.x = Sun.x;
-    Uran.y = Sun.y + Uran.Rp;
-    Uran.ax = 0;
-    Uran.ay = 0;
-    Uran.gs = 0;
-    Uran.phis = 0;
-
-    // Данные Нептуна //
-
-    Planet Neptune;
-
-    Neptune.M = 1.0243 * pow(10, 26);
-    Neptune.R = 2.4622 * pow(10, 7);
-    Neptune.Rp = 4.452940833 * pow(10, 12);
-    Neptune.Ra = 4.55394649 * pow(10, 12);
-    Neptune.Vx = 5.4349 * pow(10, 3);
-    Neptune.Vy = 0;
-    Neptune.x = Sun.x;
-    Neptune.y = Sun.y + Neptune.Rp;
-    Neptune.ax = 0;
-    Neptune.ay = 0;
-    Neptune.gs = 0;
-    Neptune.phis = 0;
+    // Юлианская дата начала миссии, время первого узла и шаг узлов, с
+    double jd, t0, h;
 
-    // Данные первой ступени //
+    // Число узлов
+    int64_t ns;
+};
 
-    Stage Ein;
+struct Mission;
 
-    Ein.Ms = 15136;
-    Ein.M = 177562;
-    Ein.Mt = Ein.M - Ein.Ms;
-    Ein.Tm = 3354;
-    Ein.Tp = 4085.2;
-    Ein.Im = 2582.973;
-    Ein.Ip = 3141.162;
+// Файл, отображённый в память только для чтения //
+struct Mapped {
 
-    // Данные второй ступени //
+    // Начало и длина отображения
+    const char* base = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    HANDLE fh = INVALID_HANDLE_VALUE;
+    HANDLE mh = nullptr;
+#endif
 
-    Stage Zwei;
+    Mapped() = default;
+    Mapped(const Mapped&) = delete;
+    Mapped& operator=(const Mapped&) = delete;
+    ~Mapped();
 
-    Zwei.Ms = 6545;
-    Zwei.M = 99765;
-    Zwei.Mt = Zwei.M - Zwei.Ms;
-    Zwei.Tm = 792.5;
-    Zwei.Tp = 990.2;
-    Zwei.Im = 2528.037;
-    Zwei.Ip = 3145.086;
+    // Отображение файла fn: 1, если удалось и файл не пуст
+    bool open(const char* fn);
+};
 
-    // Данные третьей ступени //
+// Кэш состояний тел на равномерной сетке времени: файл отображается в память
+// или узлы строятся в памяти, между узлами — кубические полиномы Эрмита //
+struct Ephemeris {
 
-    Stage Drei;
+    // Заголовок файла
+    EphemHeader hd = {};
 
-    Drei.Ms = 2355;
-    Drei.M = 27755;
-    Drei.Mt = Drei.M - Drei.Ms;
-    Drei.Tp = 294.3;
-    Drei.Ip = 3521.79;
+    // Узлы подряд, в каждом для всех тел x, y, Vx, Vy, ax, ay
+    const double* d = nullptr;
 
-    // Данные разгонного блока //
+    // Файл кэша в памяти
+    Mapped mf;
 
-    Stage Rb;
+    // Узлы, построенные в памяти
+    std::vector<double> buf;
 
-    Rb.Ms = 887;
-    Rb.M = 6280;
-    Rb.Mt = Rb.M - Rb.Ms;
-    Rb.Tp = 19.9;
-    Rb.Ip = 3268.692;
+    // Отображение файла fn: 1, если формат и размер верны
+    bool open(const char* fn);
 
-    // Данные аппарата //
+    // Узлы первых nb тел миссии m на срок tk, с, от её текущего времени с шагом h, с, в памяти
+    void build(const Mission& m, int nb, double tk, double h);
 
-    Stage A;
+    // Запись узлов в файл fn
+    bool write(const char* fn) const;
 
-    A.Ms = 605;
-    A.M = 1605;
-    A.Mt = A.M - A.Ms;
-    A.Tm = 4.7072;
-    A.Tp = 0.5884;
-    A.Ip = 3103.457;
+    // Факт узлов, покрывающих время t
+    bool has(double t) const;
+
+    // Состояния и ускорения всех тел кэша в момент t в таблицу тел b;
+    // при st = 0 — только ускорения
+    void at(double t, Bodies& b, bool st) const;
+};
+
+// Метка и версия формата контрольной точки миссии
+const char chkTag[8] = "LUNACHK";
+const uint32_t chkVer = 2;
+
+// Поток контрольной точки: одни и те же поля по порядку пишутся в os или читаются
+// из is; массивы — с длиной впереди, числа в порядке байтов машины //
+struct Archive {
+
+    std::ostream* os = nullptr;
+    std::istream* is = nullptr;
+
+    template <class T>
+    void operator()(T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "Archive: только простые поля");
+        if (os)
+            os->write((const char*)&v, sizeof v);
+        else
+            is->read((char*)&v, sizeof v);
+    }
+
+    template <class T>
+    void operator()(std::vector<T>& v) {
+        uint64_t n = v.size();
+        (*this)(n);
+        if (is) {
+            if (!*is || n > (1u << 28)) {
+                is->setstate(std::ios::failbit);
+                return;
+            }
+            v.resize(n);
+        }
+        for (T& x : v)
+            (*this)(x);
+    }
+};
+
+// Счётчики профилирования: время этапов, с, и число шагов, тактов и кадров.
+// Время этапов не пересекается: интегрирование — без сил, логика шага — без
+// перемещения и сил //
+struct Profile {
+
+    // Силы тяготения, интегрирование, логика шага, отрисовка
+    double tf = 0, ti = 0, tl = 0, td = 0;
+
+    // Шаги, такты расчёта, кадры
+    long long ns = 0, nt = 0, nd = 0;
+};
+
+// Замер времени блока, если счётчики p заданы: длительность прибавляется
+// к их полю c, если оно задано; без счётчиков часы не читаются //
+struct Lap {
 
-    Planet Rocket;
+    Profile* p;
+    double Profile::* c;
+    std::chrono::steady_clock::time_point t0;
 
-    Rocket.M = Ein.M + Zwei.M + Drei.M + Rb.M + A.M;
-    Rocket.x = Earth.x;
-    Rocket.y = Earth.y + Earth.R;
-    Rocket.Vx = Earth.Vx + 286.487;
-    Rocket.Vy = Earth.Vy;
-    Rocket.ax = 0;
-    Rocket.ay = 0;
-    Rocket.gs = 0;
-    Rocket.gp = 0;
-    Rocket.gl = 0;
-    Rocket.phis = 0;
-    Rocket.phip = 0;
-    Rocket.phil = 0;
+    Lap(Profile* p, double Profile::* c = nullptr);
+    ~Lap();
 
+    // Время от начала замера, с
+    double lap() const;
+};
+
+// Состояние, которое меняет перемещение миссии за шаг: к нему возвращается
+// поиск момента события внутри шага. Массивы заполняются поверх прежних, и
+// снимок на каждом шаге не выделяет память //
+struct Snapshot {
+
+    // Координаты, скорости и ускорения тел
+    std::vector<double> x, y, Vx, Vy, ax, ay;
+
+    // Время, длина шага, масса РН и топлива, внутренний шаг РКФ45
+    double t = 0, ds = 0, M = 0, Mtt = 0, hf = 0;
+
+    // Расстояния до Земли и Луны, направление тяги, система отсчёта РН
+    double re = 0, rl = 0, ex = 0, ey = 0, lx = 0, ly = 0;
+    int fc = -1;
+    bool ga = 0;
+
+    // Блочные шаги
+    long long nk = 0;
+    double tb = 0;
+    std::vector<long long> sk, nx;
+    std::vector<double> pax, pay, jr;
+    std::vector<int> pend;
+};
+
+// Структура состояния миссии //
+struct Mission {
+
+    // Солнце, планеты, Луна и РН
+    Bodies b;
+
+    // Ступени РН снизу вверх, последняя — аппарат
+    std::vector<Stage> stg;
 
     // Тяга двигателей на уровне моря для рассчётов, кН
-    double Tmm = Ein.Tm;
+    double Tmm = 0;
 
     // Тяга двигателей в пустоте для рассчётоы, кН
-    double Tpp = Ein.Tp;
+    double Tpp = 0;
 
     // Удельный импульс двигателей на уровне моря для рассчётов, м/с
-    double Imm = Ein.Im;
+    double Imm = 0;
 
     // Удельный импульс двигателей в пустоте для рассчётов, м/с
-    double Ipp = Ein.Ip;
+    double Ipp = 0;
 
     // Масса топлива ступени для рассчётов, кг
-    double Mtt = Ein.Mt;
+    double Mtt = 0;
 
     // Полная тяга двигателей на высоте, кН
     double Ts = 0;
@@ -380,30 +360,6 @@ int main() {
     // Полная удельная тяга на высоте, м/с
     double Is = 0;
 
-    // Счётчик времени, с
-    int T = 0;
-
-    // Скорость течения времени, с/кадр
-    int Tv = 0;
-
-    // Коэффициент масштаба, 1/м
-    double k = 5 / Jupiter.R;
-
-    // Координаты курсора мыши
-    double Mx, My, dMx = 0, dMy = 0;
-
-    // Счётчик количества нажатий клавиши мыши
-    int Tm = 0;
-
-    // Дополнительный счётчик времени, с
-    int Tvv = 0;
-
-    // Координаты объекта, относительно которой происходит отрисовка, м
-    double X = Sun.x, Y = Sun.y;
-    
-    // Переменная слежения за объектом
-    int P = 0;
-
     // Давление воздуха на данной высоте, Па
     double Pv = 0;
 
@@ -413,14 +369,36 @@ int main() {
     // Плотность воздуха на высоте, кг/м3
     double rv = 0;
 
+    // Скорость звука на высоте, м/с
+    double Vs = 0;
+
+    // Скоростной напор, Па, его наибольшее значение, Па, и время, с
+    double Q = 0, Qm = 0, tQ = 0;
+
+    // Таблица атмосферы, общая для копий миссии
+    std::shared_ptr<const Atmosphere> atm;
+
+    // Юлианская дата начала миссии, 0 — планеты в перигелиях на оси Y
+    double jd = 0;
+
+    // Кэш состояний Солнца, планет и Луны, общий для копий миссии
+    std::shared_ptr<const Ephemeris> eph;
+
+    // Число первых тел, идущих по кэшу на текущем шаге, и тела, идущие численно
+    int ne = 0;
+    std::vector<int> fr;
+
     // Ускорение РН от двигателей, м/с2
     double ad = 0;
 
-    // Отклонение вектора тяги двигателей относительно Земли, рад
-    double alpha = 0;
+    // Единичный вектор направления тяги двигателей
+    double ex = 0, ey = 1;
 
-    // Вектор направления исходной нормали
-    double Z[] = { 0, 1 };
+    // Расстояния от центров Земли и Луны до РН, м
+    double re = 0, rl = 0;
+
+    // Единичные векторы направления от Земли и от Луны на РН
+    double uxe = 0, uye = 1, uxl = 0, uyl = 1;
 
     // Счётчик времени полёта, с
     double t = 0;
@@ -431,937 +409,4777 @@ int main() {
     // Шаг времени, с
     double dt = 0.25;
 
+    // Длина последнего шага РН, с
+    double ds = 0.25;
+
+    // Модель тяготения
+    int gm = GRAV_MASK;
+
+    // Схема интегрирования
+    int in = INT_EULER;
+
+    // Допустимая ошибка положения за шаг для РКФ45, м
+    double tol = 1;
+
+    // Последний удачный внутренний шаг РКФ45, с
+    double hf = 0;
+
+    // Параметр раскрытия узлов дерева Барнса — Хата
+    double th = 0.5;
+
+    // Наибольший блочный шаг, с
+    double dtmax = 4096;
+
+    // Точность выбора блочного шага: доля времени изменения ускорения
+    double eta = 0.01;
+
+    // Блочные шаги: текущий такт длиной dt и время нулевого такта, с
+    long long nk = 0;
+    double tb = 0;
+
+    // Шаг каждого тела в тактах и такт конца его шага
+    std::vector<long long> sk, nx;
+
+    // Ускорение тела в начале шага, м/с2, и скорость его изменения, м/с3
+    std::vector<double> pax, pay, jr;
+
+    // Тела, закончившие шаг вместе с РН и ждущие начала нового
+    std::vector<int> pend;
+
+    // Число вычислений сил, на одно тело каждое
+    long long nf = 0;
+
+    // Порог возмущения для переноса по Кеплеру, доля притяжения центрального тела, 0 — нет
+    double kp = 0;
+
+    // Шаг, когда все тела идут по Кеплеру или без ускорения, с
+    double dk = 600;
+
+    // Центральное тело каждого тела при переносе по Кеплеру, -1 — численно;
+    // выбирается на участке полёта РН без тяги один раз и держится, пока
+    // возмущение меньше порога
+    std::vector<int> kb;
+
+    // Гравитационный параметр пары тел, м3/с2, и возмущающее ускорение, м/с2
+    std::vector<double> km, kax, kay;
+
+    // Факт шага по Кеплеру: все ускоряемые тела имеют центральные тела
+    bool kl = 0;
+
+    // Факт ускорений тяготения, уже вычисленных для текущих положений
+    bool ga = 0;
+
+    // Режим сфер действия: положение РН хранится относительно тела fc
+    bool soi = 0;
+    int fc = -1;
+
+    // Положение РН относительно центра системы отсчёта, м
+    double lx = 0, ly = 0;
+
+    // Радиусы сфер действия Луны и Земли в долях их расстояний до Земли и Солнца
+    double sl = 0, se = 0;
+
     // Требуемые импульсы для гомановских орбит, м/с
     double Vg1 = 0, Vg2 = 0, Vg3 = 0;
 
     // Полученные импульсы для гомановских орбит, м/с
     double dV = 0;
 
-    // Время начала импульсов, с
-    double t1 = 3550, t2 = 340700, t3 = 346500, t4 = 349990;
+    // Время начала импульсов, с. Подобраны для схемы Эйлера с шагом 0,25 с; полёт
+    // хаотичен, и другим режимам burns() задаёт своё t1
+    double t1 = 3586, t2 = 340700, t3 = 346500, t4 = 349990;
+
+    // Границы окон манёвров: выход на орбиту Земли, конец второго импульса,
+    // выход на орбиту Луны, конец третьего импульса, с
+    double w1 = 3000, w2 = 345500, w3 = 346000, w4 = 349700;
+
+    // Точность поиска момента события внутри шага, с
+    double te = 0.001;
+
+    // Предел шага РН в тактах при поиске события на блочных шагах, 0 — нет
+    long long kc = 0;
 
     // Факт нужной скорости при спуске к Луне
     bool st = 0;
 
-    while (window.isOpen()) {
+    // Факт посадки на Луну
+    bool land = 0;
 
-        Event event;
-        while (window.pollEvent(event)) {
-            
-            if (event.type == Event::Closed)
-                window.close();
+    // Запас первого импульса к расчётному и множители второго и третьего импульсов
+    double kg = 1.015, k2 = 1, k3 = 1;
 
-            // Изменение объекта, относительно которого происходит отрисовка
-            if (Keyboard::isKeyPressed(Keyboard::Numpad0)) {
-                P = 0;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad1)) {
-                dMx = 0;
-                dMy = 0;
-                P = 1;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad2)) {
-                P = 2;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad3)) {
-                P = 3;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad4)) {
-                P = 4;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad5)) {
-                P = 5;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad6)) {
-                P = 6;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad7)) {
-                P = 7;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad8)) {
-                P = 8;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Numpad9)) {
-                P = 9;
-                dMx = 0;
-                dMy = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Num0)) {
-                P = 10;
-                dMx = 0;
-                dMy = 0;
-            }
+    // Наименьшая высота РН над Луной, м
+    double hm = 1e300;
 
-            // Изменение скорости течения времени
-            if (Keyboard::isKeyPressed(Keyboard::Down) && Keyboard::isKeyPressed(Keyboard::LControl)) {
-                    Tv -= 5;
-                if (Tv < 0)
-                    Tv = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Up) && Keyboard::isKeyPressed(Keyboard::LControl)) {
-                if (Tv > 1000)
-                    Tv += 50;
-                else
-                    Tv += 5;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Down)) {
-                if (Tv >= 1000)
-                    Tv -= 500;
-                else if (Tv >= 10000)
-                    Tv -= 5000;
-                else
-                    Tv -= 50;
-                    if (Tv < 0)
-                        Tv = 0;
-            }
-            else if (Keyboard::isKeyPressed(Keyboard::Up)) {
-                if (Tv >= 1000)
-                    Tv += 500;
-                else if (Tv >= 10000)
-                    Tv += 5000;
-                else
-                    Tv += 50;
-            }
-            if (Keyboard::isKeyPressed(Keyboard::LAlt)) {
-                if (Tv != 0) {
-                    Tvv = Tv;
-                    Tv = 0;
-                }
-                else if (Tvv != 0)
-                    Tv = Tvv;
-            }
+    // Скачок скорости при выходе на орбиты Земли и Луны — ошибка выведения, м/с
+    double ie = 0, il = 0;
 
-            // Изменение масштаба
-            if (event.type == Event::MouseWheelScrolled && Keyboard::isKeyPressed(Keyboard::LControl)) {
-                if (event.mouseWheelScroll.delta < 0) {
-                    k -= 0.1 / Earth.R;
-                    if (k < 0)
-                        k = 0;
-                }
-                else if (event.mouseWheelScroll.delta > 0)
-                    k += 0.1 / Earth.R;
-            }
-            else if (event.type == Event::MouseWheelScrolled) {
-                if (event.mouseWheelScroll.delta < 0) {
-                    k -= 5 / Earth.R;
-                    if (k < 0)
-                        k = 0;
-                }
-                else if (event.mouseWheelScroll.delta > 0)
-                    k += 5 / Earth.R;
-            }
+    // Факт выхода на орбиту Луны
+    bool ol = 0;
 
-            // Перемещение по окну
-            if (event.type == Event::MouseButtonPressed) {
-                if (event.mouseButton.button == Mouse::Left) {
-                    if (Tm % 2 == 0) {
-                        Vector2i M = Mouse::getPosition(window);
-                        Mx = M.x;
-                        My = M.y;
-                    }
-                        Tm++;
+    // Скорость РН относительно Луны при посадке, м/с
+    double vt = 0;
+
+    // Счётчики профилирования, если заданы; в контрольную точку не входят
+    Profile* pr = nullptr;
+
+    // Начальные данные миссии
+    void init();
+
+    // Планеты на юлианскую дату jd по средним элементам орбит
+    void epoch(double jd);
+
+    // Число первых тел, идущих по кэшу на отрезке времени от t0 до t1
+    int cached(double t0, double t1);
+
+    // Один шаг интегрирования по времени
+    void step();
+
+    // Снимок состояния, которое меняет перемещение, и возврат к нему
+    void mark(Snapshot& c) const;
+    void rewind(const Snapshot& c);
+
+    // Факт спокойного шага: Эйлер, тяготение по маскам, тела кроме РН из кэша,
+    // РН без тяги вне атмосферы, без событий по времени и смены ступени на шаге
+    bool calm();
+
+    // Расчёт расстояний и направлений РН относительно Земли и Луны
+    void rel();
+
+    // Ускорения всех тел в текущем состоянии: тяготение и тяга РН
+    void accel();
+
+    // Ускорения тяготения тел act (всех, если не заданы) со счётом вычислений сил
+    void force(const std::vector<int>* act = nullptr);
+
+    // Ускорение РН от двигателей и сопротивления воздуха в текущем положении, м/с2
+    void jet(double& ax, double& ay);
+
+    // Скорость РН относительно воздуха, вращающегося вместе с Землёй, м/с
+    void air(double& vx, double& vy);
+
+    // Работающая ступень
+    const Stage& stage();
+
+    // Параметры ступени k для рассчётов и масса РН со ступенями от k-й
+    void load(int k);
+
+    // Таблица ступеней из файла: 1, если прочитана
+    bool vehicle(const char* fn);
+
+    // Время первого импульса, с которым садятся на Луну текущие схема, шаг и перенос по Кеплеру
+    void burns();
+
+    // Все поля состояния по порядку для контрольной точки
+    template <class A>
+    void io(A& a);
+
+    // Запись контрольной точки в файл fn и восстановление из него: 1, если удалось.
+    // Таблица атмосферы и кэш состояний тел не пишутся и остаются прежними
+    bool save(const char* fn);
+    bool restore(const char* fn);
+
+    // Перемещение всех тел на шаг h выбранной схемой
+    void integrate(double h);
+
+    // Шаг h со сменой времени, расстояний до РН и расходом топлива
+    void move(double h);
+
+    // Ближайшее событие по времени после t, с
+    double next(double t);
+
+    // Тела, идущие на шаге по Кеплеру; 1, если численно идут только тела без ускорения
+    bool coast();
+
+    // Факт работы режима сфер действия: только для схем из дрейфов и толчков
+    bool local();
+
+    // Тело, в сфере действия которого находится РН: Луна, Земля или Солнце
+    int dominant();
+
+    // Перенос центра системы отсчёта РН на тело c
+    void frame(int c);
+
+    // Вектор от тела j до РН, м
+    void dist(int j, double& dx, double& dy);
+
+    // Функции событий по состоянию: событие k наступает, когда g[k] становится <= 0
+    void events(double* g);
+
+    // Схемы интегрирования на шаг h
+    void leapfrog(double h);
+    void yoshida(double h);
+    void rk4(double h);
+    void rkf45(double h);
+
+    // Дрейф координат и толчок скоростей всех тел на время h
+    void drift(double h);
+    void kick(double h);
+
+    // Блочные шаги до конца текущего шага РН и начало шагов тел из списка
+    void block();
+    void open(const std::vector<int>& act);
+
+    // Шаг явного метода Рунге — Кутты по таблице Бутчера, возвращает оценку ошибки, м
+    double rk(int ns, const double A[][6], const double* B, const double* E, double h);
+};
+
+// Следы тел: кольцо выборок координат тел с шагом dt по времени миссии, память
+// выделяется один раз; частицы пояса (номера после РН) следов не имеют //
+struct Trails {
+
+    // Шаг выборки, с
+    double dt = 60;
+
+    // Ёмкость кольца, выборок
+    int K = 2048;
+
+    // Число тел со следами
+    int n = 0;
+
+    // Выборки строками по n тел
+    std::vector<double> x, y;
+
+    // Всего выборок и время следующей
+    long long cnt = 0;
+    double tn = 0;
+
+    // Защита кольца между потоком расчёта и отрисовкой
+    std::mutex mx;
+
+    // Выделение кольца для таблицы тел b
+    void init(const Bodies& b);
+
+    // Выборка координат тел b в момент t, если настало её время
+    void put(const Bodies& b, double t);
+};
+
+// Общие данные потока расчёта и потока отрисовки //
+struct Shared {
+
+    // Двойной буфер состояния миссии для отрисовки
+    Mission buf[2];
+
+    // Индекс буфера, из которого читает отрисовка
+    int front = 0;
+
+    // Номер публикации и моменты публикации буферов
+    long long seq = 0;
+    std::chrono::steady_clock::time_point ts[2];
+
+    // Счётчики профилирования расчёта на момент публикации
+    Profile pf;
+
+    // Защита смены буферов
+    std::mutex mx;
+
+    // Скорость течения времени, шагов/такт
+    std::atomic<int> Tv{ 0 };
+
+    // Факт работы потока расчёта
+    std::atomic<bool> run{ true };
+
+    // Следы тел
+    Trails tr;
+};
+
+// Метка и версия формата записи траектории
+const char recTag[8] = "LUNAREC";
+const uint32_t recVer = 2;
+
+// Запись траектории в двоичный файл по столбцам: заголовок с именами столбцов,
+// затем блоки — число строк (8 байт) и столбцы подряд; заголовок и счётчики кратны
+// 8 байтам, и столбцы в отображённом файле выровнены по double. Строки копятся в кольце блоков,
+// полные блоки переставляет по столбцам и пишет фоновый поток, шаг расчёта
+// только копирует числа строки подряд //
+struct Recorder {
+
+    // Строк в блоке и блоков в кольце
+    static const int K = 4096;
+    static const int NR = 8;
+
+    // Тела, чьи координаты, скорости и массы пишутся
+    std::vector<int> bs;
+
+    // Запись каждого N-го шага и при смене этапа полёта
+    long long N = 1;
+
+    // Число столбцов и кольцо блоков по строкам
+    int nc = 0;
+    std::vector<double> ring[NR];
+
+    // Блок, который заполняется, строка в нём и число полных блоков в очереди
+    int wb = 0, r = 0, full = 0;
+
+    // Счётчик шагов и код последнего этапа полёта
+    long long n = 0;
+    int ph = -1;
+
+    std::ofstream fs;
+    std::thread th;
+    std::mutex mx;
+    std::condition_variable cv;
+    bool done = 0;
+
+    ~Recorder();
+
+    // Открытие файла fn и запись начального состояния миссии m: 1, если удалось
+    bool open(const char* fn, const Mission& m, const std::vector<int>& bodies, long long N);
+
+    // Строка после шага: каждый N-й шаг и при смене этапа
+    void put(const Mission& m);
+
+    // Остаток строк в файл и остановка потока записи
+    void close();
+
+    // Строка состояния миссии
+    void row(const Mission& m);
+
+    // Фоновая запись полных блоков
+    void writer();
+
+    // Запись k строк блока b по столбцам
+    void flush(int b, int k, std::vector<double>& cs);
+};
+
+// Запись траектории, отображённая в память, для просмотра без расчёта //
+struct Replay {
+
+    // Файл записи в памяти
+    Mapped mf;
+
+    // Число столбцов
+    int nc = 0;
+
+    // Блоки: первая строка, число строк и начало столбцов
+    std::vector<long long> r0;
+    std::vector<uint64_t> rk;
+    std::vector<const double*> cp;
+
+    // Всего строк, время первой и последней, с
+    long long nr = 0;
+    double t0 = 0, t1 = 0;
+
+    // Записанные тела: номер тела и столбец его координаты x
+    std::vector<int> bi, bx;
+
+    // Факт записи тела по его номеру
+    std::vector<char> rec;
+
+    // Разбор файла записи fn для таблицы из n тел: 1, если формат верен
+    bool open(const char* fn, int n);
+
+    // Значение столбца c в строке r
+    double val(int c, long long r) const;
+
+    // Координаты, скорости и массы записанных тел в момент t в таблицу тел b:
+    // координаты — кубическим полиномом Эрмита по соседним строкам
+    void at(double t, Bodies& b) const;
+};
+
+// Перевод координат миссии в пиксели окна: разность с точкой в центре окна
+// считается в double, во float переводится только малая экранная координата //
+struct Camera {
+
+    // Точка в центре окна, м
+    double X = 0, Y = 0;
+
+    // Масштаб, 1/м
+    double k = 1;
+
+    // Сдвиг, пиксели
+    double dx = 0, dy = 0;
+
+    // Экранные координаты точки (x, y), пиксели
+    double sx(double x) const;
+    double sy(double y) const;
+};
+
+// Отрисовка тел одним массивом треугольников за кадр: окружность и массив
+// вершин создаются один раз, память массива не освобождается между кадрами //
+struct Painter {
+
+    // Число сторон многоугольника наибольшего круга
+    static const int NS = 64;
+
+    // Единичная окружность
+    float cs[NS + 1], sn[NS + 1];
+
+    // Треугольники кадра
+    VertexArray va{ Triangles };
+
+    // Ломаные следов тел
+    std::vector<VertexArray> tl;
+
+    Painter();
+
+    // Следы тел кольца tr в системе тела P через камеру cm; b — текущее состояние
+    void trails(RenderWindow& w, Trails& tr, const Bodies& b, int P, const Camera& cm);
+
+    // Тела b в окне w через камеру cm; on — рисуемые тела, если задано
+    void draw(RenderWindow& w, const Bodies& b, const Camera& cm, const std::vector<char>* on);
+};
+
+// Пачка миссий в полосах: на спокойном шаге состояния РН и притягивающих её тел
+// собираются в структуру массивов по полосам, и шаг считается для всех полос
+// сразу одними и теми же действиями с маской полос. Полоса, где шаг не спокоен
+// или за шаг пересекается поверхность события, делает этот шаг своей миссией,
+// поэтому итог совпадает с расчётом миссий по одной //
+struct Lanes {
+
+    // Наибольшее число полос и тел, притягивающих РН
+    static const int W = 8;
+    static const int NJ = 8;
+
+    // Миссии полос, время их окончания, с, и число полос
+    Mission* c[W];
+    double te[W];
+    int nl = 0;
+
+    // Факт устаревших состояний тел вне J у миссии полосы
+    bool old[W] = {};
+
+    // Тела, притягивающие РН, их число и места Земли и Луны среди них
+    int J[NJ];
+    int nj = 0, je = -1, jl = -1;
+
+    // Шаги всех полос: всего и спокойных
+    long long ns = 0, nq = 0;
+
+    // Добавление миссии m до времени te
+    void add(Mission* m, double te);
+
+    // Расчёт всех полос до посадки или до своего времени окончания
+    void run();
+
+    // Обычный шаг миссии полосы l
+    void single(int l);
+};
+
+// Разбросы параметров для статистических испытаний: среднеквадратичные отклонения
+// тяги, удельного импульса, масс ступеней и запаса первого импульса в долях,
+// времён начала импульсов в секундах //
+struct Dispersion {
+    double T = 0.01;
+    double I = 0.002;
+    double M = 0.005;
+    double kg = 0.001;
+    double tb = 1;
+};
+
+// Поток ведёт одну из параллельных миссий: тяготение считается в нём одном
+thread_local bool solo = 0;
+
+double norm(double x, double y);
+double clamp(double value, double min, double max);
+void gravity(Bodies& b, int gm, double th, const std::vector<int>* act = nullptr);
+void gravityMask(Bodies& b, const std::vector<int>* act);
+void gravityPair(Bodies& b, const std::vector<int>* act);
+void gravityTree(Bodies& b, double th, const std::vector<int>* act);
+bool kepler(double mu, double& x, double& y, double& vx, double& vy, double h);
+void belt(Bodies& b, int N);
+void blend(const Bodies& a, const Bodies& c, double s, double h, Bodies& o);
+double julian(const char* s);
+int headless(Mission& m, double tk, Recorder* rec, const char* qf, long long qn);
+double uniform(unsigned long long& q);
+void disperse(Mission& m, const Dispersion& d, unsigned long long seed);
+int optimize(Mission m, int ng, int nt, unsigned long long seed, bool fuel, double tk);
+int montecarlo(const Mission& m, int N, int nt, int nw, unsigned long long seed, const Dispersion& d, double tk, const char* fn);
+void worker(Mission m, Shared& sh, Recorder* rec);
+
+// Окно создаётся только в оконном режиме
+RenderWindow window;
+
+int main(int argc, char* argv[]) {
+
+    Mission m;
+    m.init();
+
+    // Режим без окна
+    bool hl = 0;
+
+    // Время окончания расчёта без окна, с
+    double tk = 1e6;
+
+    // Статистические испытания: число миссий, потоков, миссий в пачке полос, зерно,
+    // разбросы и файл итогов
+    int mc = 0;
+    int nt = std::thread::hardware_concurrency();
+    int nw = Lanes::W;
+    unsigned long long seed = 1;
+    Dispersion dp;
+    const char* mf = "mc.csv";
+
+    // Просмотр записи траектории вместо расчёта
+    const char* pf = nullptr;
+
+    // Следы тел: шаг выборки, с, и ёмкость кольца, выборок
+    double sd = 60;
+    int sk = 2048;
+
+    // Счётчики профилирования без окна: файл CSV и шагов на строку
+    const char* qf = nullptr;
+    long long qn = 10000;
+
+    // Запись траектории: файл, шаг прореживания и тела
+    const char* rf = nullptr;
+    long long rn = 1;
+    std::vector<int> rb = { ROCKET, EARTH, LUNA };
+
+    // Контрольная точка: время записи, с, и файл
+    double ts = -1;
+    const char* sf = nullptr;
+
+    // Поиск импульсов: число поколений и цель — экономия топлива или точность орбит
+    int og = 0;
+    bool fuel = 0;
+
+    // Факт времён импульсов из командной строки или контрольной точки
+    bool bt = 0;
+
+    // Файл кэша состояний тел для чтения и для записи, срок записи, сут, и шаг узлов, с
+    const char* ef = nullptr;
+    const char* eb = nullptr;
+    double ed = 0, eh = 600;
+
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-headless") == 0) {
+            hl = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                tk = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-gravity") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "pair") == 0)
+                m.gm = GRAV_PAIR;
+            else if (strcmp(argv[i], "tree") == 0)
+                m.gm = GRAV_TREE;
+            else
+                m.gm = GRAV_MASK;
+        }
+        else if (strcmp(argv[i], "-theta") == 0 && i + 1 < argc) {
+            m.th = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-integrator") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "leapfrog") == 0)
+                m.in = INT_LEAP;
+            else if (strcmp(argv[i], "yoshida") == 0)
+                m.in = INT_YOSHIDA;
+            else if (strcmp(argv[i], "rk4") == 0)
+                m.in = INT_RK4;
+            else if (strcmp(argv[i], "rkf45") == 0)
+                m.in = INT_RKF45;
+            else if (strcmp(argv[i], "block") == 0)
+                m.in = INT_BLOCK;
+            else
+                m.in = INT_EULER;
+        }
+        else if (strcmp(argv[i], "-dt") == 0 && i + 1 < argc) {
+            m.dt = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-tol") == 0 && i + 1 < argc) {
+            m.tol = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-dtmax") == 0 && i + 1 < argc) {
+            m.dtmax = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-eta") == 0 && i + 1 < argc) {
+            m.eta = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-kepler") == 0 && i + 1 < argc) {
+            m.kp = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-kstep") == 0 && i + 1 < argc) {
+            m.dk = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-soi") == 0) {
+            m.soi = 1;
+        }
+        else if (strcmp(argv[i], "-vehicle") == 0 && i + 1 < argc) {
+            if (!m.vehicle(argv[++i])) {
+                std::cerr << "Luna: не удалось прочитать ступени из " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-belt") == 0 && i + 1 < argc) {
+            belt(m.b, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-date") == 0 && i + 1 < argc) {
+            double jd = julian(argv[++i]);
+            if (jd == 0) {
+                std::cerr << "Luna: дата должна иметь вид ГГГГ-ММ-ДД или ГГГГ-ММ-ДДTчч:мм: " << argv[i] << std::endl;
+                return 1;
+            }
+            m.epoch(jd);
+        }
+        else if (strcmp(argv[i], "-mc") == 0 && i + 1 < argc) {
+            mc = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                mf = argv[++i];
+        }
+        else if (strcmp(argv[i], "-lanes") == 0 && i + 1 < argc) {
+            nw = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            nt = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-disp") == 0 && i + 5 < argc) {
+            dp.T = atof(argv[++i]);
+            dp.I = atof(argv[++i]);
+            dp.M = atof(argv[++i]);
+            dp.kg = atof(argv[++i]);
+            dp.tb = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-optimize") == 0 && i + 1 < argc) {
+            og = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                fuel = strcmp(argv[++i], "fuel") == 0;
+        }
+        else if (strcmp(argv[i], "-burns") == 0 && i + 4 < argc) {
+            bt = 1;
+            m.t1 = atof(argv[++i]);
+            m.t2 = atof(argv[++i]);
+            m.t3 = atof(argv[++i]);
+            m.t4 = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-gains") == 0 && i + 3 < argc) {
+            m.kg = atof(argv[++i]);
+            m.k2 = atof(argv[++i]);
+            m.k3 = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-rec") == 0 && i + 1 < argc) {
+            rf = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                rn = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-recbodies") == 0 && i + 1 < argc) {
+            rb.clear();
+            for (const char* p = argv[++i]; *p;) {
+                char* e;
+                rb.push_back((int)strtol(p, &e, 10));
+                if (e == p)
+                    break;
+                p = *e == ',' ? e + 1 : e;
+            }
+        }
+        else if (strcmp(argv[i], "-prof") == 0 && i + 1 < argc) {
+            qf = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                qn = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-trail") == 0 && i + 1 < argc) {
+            sd = atof(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                sk = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+            pf = argv[++i];
+        }
+        else if (strcmp(argv[i], "-save") == 0 && i + 2 < argc) {
+            ts = atof(argv[++i]);
+            sf = argv[++i];
+        }
+        else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc) {
+            if (!m.restore(argv[++i])) {
+                std::cerr << "Luna: контрольная точка " << argv[i] << " не читается" << std::endl;
+                return 1;
+            }
+            bt = 1;
+        }
+        else if (strcmp(argv[i], "-ephem") == 0 && i + 1 < argc) {
+            ef = argv[++i];
+        }
+        else if (strcmp(argv[i], "-ephem-build") == 0 && i + 2 < argc) {
+            eb = argv[++i];
+            ed = atof(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                eh = atof(argv[++i]);
+        }
+    }
+
+    // Первый импульс по выбранным схеме, шагу и переносу по Кеплеру
+    if (!bt)
+        m.burns();
+
+    // Запись кэша состояний Солнца, планет и Луны и выход
+    if (eb) {
+        Ephemeris e;
+        if (ed > 0 && eh > 0)
+            e.build(m, ROCKET, ed * 86400, eh);
+        if (!e.d || !e.write(eb)) {
+            std::cerr << "Luna: не удалось записать кэш " << eb << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Солнце, планеты и Луна из кэша той же даты
+    if (ef) {
+        auto e = std::make_shared<Ephemeris>();
+        if (!e->open(ef) || e->hd.nb != ROCKET || e->hd.jd != m.jd || e->hd.t0 > m.t) {
+            std::cerr << "Luna: кэш " << ef << " не читается или записан для другой даты" << std::endl;
+            return 1;
+        }
+        m.eph = e;
+    }
+
+    // Расчёт без окна до времени ts, запись контрольной точки и выход
+    if (sf) {
+        while (m.t < ts && !m.land)
+            m.step();
+        if (!m.save(sf)) {
+            std::cerr << "Luna: не удалось записать " << sf << std::endl;
+            return 1;
+        }
+        std::cout << "saved at t = " << m.t << " s" << std::endl;
+        return 0;
+    }
+
+    if (mc > 0 || og > 0) {
+
+        // Солнце, планеты и Луна одни на все миссии: общий кэш в памяти до часа после
+        // самого позднего начала посадки, так что каждая миссия ведёт численно только РН;
+        // срок кэша — от времени миссии, в том числе восстановленной из контрольной точки
+        if (!m.eph && m.in != INT_BLOCK) {
+            auto e = std::make_shared<Ephemeris>();
+            e->build(m, ROCKET, fmax(fmin(tk, fmax(m.t4 + 10 * dp.tb, m.w4 + 2000) + 3600) - m.t, 0), eh);
+            m.eph = e;
+        }
+
+        if (og > 0)
+            return optimize(m, og, nt > 0 ? nt : 1, seed, fuel, tk);
+
+        return montecarlo(m, mc, nt > 0 ? nt : 1, nw, seed, dp, tk, mf);
+    }
+
+    // Запись для просмотра
+    Replay rpl;
+    if (pf && !rpl.open(pf, m.b.n)) {
+        std::cerr << "Luna: запись траектории " << pf << " не читается" << std::endl;
+        return 1;
+    }
+
+    // Запись траектории без окна и в окне
+    Recorder rec;
+    if (rf && !pf && !rec.open(rf, m, rb, rn)) {
+        std::cerr << "Luna: не удалось записать траекторию в " << rf << std::endl;
+        return 1;
+    }
+    Recorder* rp = rf && !pf ? &rec : nullptr;
+
+    if (hl && !pf)
+        return headless(m, tk, rp, qf, qn);
+
+    window.create(VideoMode(width, height), "Luna");
+    window.setFramerateLimit(60);
+
+    // Расчёт идёт в отдельном потоке, отрисовка читает его снимки;
+    // при просмотре записи расчёта нет
+    Shared sh;
+    sh.buf[0] = m;
+    sh.buf[1] = m;
+    sh.tr.dt = sd > 0 ? sd : 60;
+    sh.tr.K = sk > 1 ? sk : 2;
+    sh.tr.init(m.b);
+    std::thread th;
+    if (!pf)
+        th = std::thread(worker, m, std::ref(sh), rp);
+
+    // Снимок состояния миссии для текущего кадра
+    Mission v = m;
+    const Bodies& b = v.b;
+
+    // Два последних опубликованных снимка, моменты их публикации и номер последнего:
+    // кадр показывает состояние между ними, отставая от расчёта на один такт
+    Mission p0 = m, p1 = m;
+    std::chrono::steady_clock::time_point c0, c1;
+    long long sq = 0;
+
+    // Скорость течения времени, шагов/кадр
+    std::atomic<int>& Tv = sh.Tv;
+
+    // Коэффициент масштаба, 1/м
+    double k = 5 / b.R[JUPITER];
+
+    // Координаты курсора мыши
+    double Mx, My, dMx = 0, dMy = 0;
+
+    // Счётчик количества нажатий клавиши мыши
+    int Tm = 0;
+
+    // Дополнительный счётчик времени, с
+    int Tvv = 0;
+
+    // Координаты объекта, относительно которой происходит отрисовка, м
+    double X = b.x[SUN], Y = b.y[SUN];
+    
+    // Переменная слежения за объектом
+    int P = 0;
+
+    // Время просмотра записи, с, и направление хода
+    double tr = rpl.t0;
+    int dir = 1;
+
+    // Отрисовка тел и факт показа следов
+    Painter pnt;
+    bool tv = 1;
+
+    // Профилирование: факт показа, счётчики расчёта и отрисовки сейчас и на начало
+    // окна усреднения, его начало; без шрифта счётчики идут в заголовок окна
+    bool ov = 0;
+    Profile q, q0;
+    auto qc = std::chrono::steady_clock::now();
+    Font fnt;
+    const bool fo = fnt.loadFromFile("C:/Windows/Fonts/consola.ttf") || fnt.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf");
+    Text ot("", fnt, 14);
+    ot.setFillColor(Color::Black);
+    ot.setPosition(10, 10);
+
+    while (window.isOpen()) {
+
+        Event event;
+        while (window.pollEvent(event)) {
+            
+            if (event.type == Event::Closed)
+                window.close();
+
+            // Изменение объекта, относительно которого происходит отрисовка
+            if (Keyboard::isKeyPressed(Keyboard::Numpad0)) {
+                P = 0;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad1)) {
+                dMx = 0;
+                dMy = 0;
+                P = 1;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad2)) {
+                P = 2;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad3)) {
+                P = 3;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad4)) {
+                P = 4;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad5)) {
+                P = 5;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad6)) {
+                P = 6;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad7)) {
+                P = 7;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad8)) {
+                P = 8;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Numpad9)) {
+                P = 9;
+                dMx = 0;
+                dMy = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Num0)) {
+                P = 10;
+                dMx = 0;
+                dMy = 0;
+            }
+
+            // Изменение скорости течения времени
+            if (Keyboard::isKeyPressed(Keyboard::Down) && Keyboard::isKeyPressed(Keyboard::LControl)) {
+                    Tv -= 5;
+                if (Tv < 0)
+                    Tv = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Up) && Keyboard::isKeyPressed(Keyboard::LControl)) {
+                if (Tv > 1000)
+                    Tv += 50;
+                else
+                    Tv += 5;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Down)) {
+                if (Tv >= 1000)
+                    Tv -= 500;
+                else if (Tv >= 10000)
+                    Tv -= 5000;
+                else
+                    Tv -= 50;
+                    if (Tv < 0)
+                        Tv = 0;
+            }
+            else if (Keyboard::isKeyPressed(Keyboard::Up)) {
+                if (Tv >= 1000)
+                    Tv += 500;
+                else if (Tv >= 10000)
+                    Tv += 5000;
+                else
+                    Tv += 50;
+            }
+            if (Keyboard::isKeyPressed(Keyboard::LAlt)) {
+                if (Tv != 0) {
+                    Tvv = Tv;
+                    Tv = 0;
+                }
+                else if (Tvv != 0)
+                    Tv = Tvv;
+            }
+
+            // Просмотр записи: перемотка на сотую записи стрелками влево и вправо,
+            // обратный ход — B, начало и конец — Home и End
+            if (pf && event.type == Event::KeyPressed) {
+                if (event.key.code == Keyboard::Left)
+                    tr -= (rpl.t1 - rpl.t0) / 100;
+                else if (event.key.code == Keyboard::Right)
+                    tr += (rpl.t1 - rpl.t0) / 100;
+                else if (event.key.code == Keyboard::B)
+                    dir = -dir;
+                else if (event.key.code == Keyboard::Home)
+                    tr = rpl.t0;
+                else if (event.key.code == Keyboard::End)
+                    tr = rpl.t1;
+            }
+
+            // Показ и скрытие следов тел
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::T)
+                tv = !tv;
+
+            // Показ и скрытие счётчиков профилирования
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::F3) {
+                ov = !ov;
+                if (!ov && !fo)
+                    window.setTitle("Luna");
+            }
+
+            // Изменение масштаба в логарифмической шкале: щелчок колеса — в 1,25 раза,
+            // с LControl — в 1,02 раза, на любом масштабе одинаково
+            if (event.type == Event::MouseWheelScrolled)
+                k *= pow(Keyboard::isKeyPressed(Keyboard::LControl) ? 1.02 : 1.25, event.mouseWheelScroll.delta);
+
+            // Перемещение по окну
+            if (event.type == Event::MouseButtonPressed) {
+                if (event.mouseButton.button == Mouse::Left) {
+                    if (Tm % 2 == 0) {
+                        Vector2i M = Mouse::getPosition(window);
+                        Mx = M.x;
+                        My = M.y;
+                    }
+                        Tm++;
+                }
+            }
+
+            // Возврат камеры в изначальное положение
+            if (Keyboard::isKeyPressed(Keyboard::R)) {
+                dMx = 0;
+                dMy = 0;
+            }
+
+            // При изменении размеров окна картинка не искажается
+            if (event.type == Event::Resized) {
+                FloatRect visibleArea(0.f, 0.f, event.size.width, event.size.height);
+                window.setView(View(visibleArea));
+            }
+        }
+
+        // Последний опубликованный снимок состояния или момент записи: время
+        // идёт на Tv шагов за кадр в выбранную сторону
+        if (pf) {
+            tr = clamp(tr + dir * Tv * v.dt, rpl.t0, rpl.t1);
+            rpl.at(tr, v.b);
+        }
+        else {
+            {
+                std::lock_guard<std::mutex> lk(sh.mx);
+                if (sh.seq != sq) {
+                    sq = sh.seq;
+                    std::swap(p0, p1);
+                    p1 = sh.buf[sh.front];
+                    c0 = c1;
+                    c1 = sh.ts[sh.front];
+                    v = p1;
+                }
+                q.tf = sh.pf.tf;
+                q.ti = sh.pf.ti;
+                q.tl = sh.pf.tl;
+                q.ns = sh.pf.ns;
+                q.nt = sh.pf.nt;
+            }
+
+            // Доля такта, прошедшая с публикации последнего снимка
+            double s = 1;
+            if (c1 > c0)
+                s = clamp(std::chrono::duration<double>(std::chrono::steady_clock::now() - c1) / (c1 - c0), 0, 1);
+            blend(p0.b, p1.b, s, p1.t - p0.t, v.b);
+        }
+
+        // Измненение объекта, относительно которого происходит отрисовка;
+        // при просмотре — только записанного
+        if (!pf || rpl.rec[P]) {
+            X = b.x[P];
+            Y = b.y[P];
+        }
+
+        // Перемещение по окну
+        if (Tm % 2 != 0) {
+            Vector2i M = Mouse::getPosition(window);
+            dMx += M.x - Mx;
+            dMy += M.y - My;
+            Mx = M.x;
+            My = M.y;
+        }
+
+        // Чёрное пространство
+        Lap lp(&q);
+        window.clear(Color::White);
+
+        // Отрисовка объектов //
+
+        const Camera cm{ X, Y, k, dMx, dMy };
+        if (tv && !pf)
+            pnt.trails(window, sh.tr, b, P, cm);
+        pnt.draw(window, b, cm, pf ? &rpl.rec : nullptr);
+
+        // Счётчики за последние полсекунды: расчёт — на такт, отрисовка — на кадр
+        // без ожидания смены кадра
+        q.td += lp.lap();
+        q.nd++;
+        const double qw = std::chrono::duration<double>(std::chrono::steady_clock::now() - qc).count();
+        if (qw >= 0.5) {
+            const double nt = fmax(q.nt - q0.nt, 1), nd = fmax(q.nd - q0.nd, 1);
+            char str[256];
+            snprintf(str, sizeof str, "t = %.1f s  s = %d  Tv = %d\nsteps/s %.0f  frame %.2f ms\nforce %.2f  integrate %.2f  logic %.2f  draw %.2f ms",
+                pf ? tr : v.t, v.s, (int)Tv, (q.ns - q0.ns) / qw, qw / nd * 1000,
+                (q.tf - q0.tf) / nt * 1000, (q.ti - q0.ti) / nt * 1000, (q.tl - q0.tl) / nt * 1000, (q.td - q0.td) / nd * 1000);
+            ot.setString(str);
+            if (ov && !fo) {
+                for (char* c = str; *c; c++)
+                    if (*c == '\n')
+                        *c = ' ';
+                window.setTitle(str);
+            }
+            q0 = q;
+            qc = std::chrono::steady_clock::now();
+        }
+        if (ov && fo)
+            window.draw(ot);
+
+        window.display();
+    }
+
+    sh.run = 0;
+    if (th.joinable())
+        th.join();
+
+    return 0;
+}
+
+// Единичная окружность для многоугольников тел
+Painter::Painter() {
+    for (int j = 0; j <= NS; j++) {
+        cs[j] = (float)cos(2 * pi * j / NS);
+        sn[j] = (float)sin(2 * pi * j / NS);
+    }
+}
+
+// Экранная абсцисса точки x
+double Camera::sx(double x) const {
+    return width / 2 + (x - X) * k + dx;
+}
+
+// Экранная ордината точки y
+double Camera::sy(double y) const {
+    return height / 2 + (y - Y) * k + dy;
+}
+
+// Тела в окне одним вызовом отрисовки: тела вне окна отбрасываются, тела меньше
+// точки 5 пикселей (и РН без радиуса) рисуются такой точкой, число сторон
+// многоугольника растёт с радиусом от 8 до NS. У кругов больше окна вершины
+// ставятся только на дуге возле окна: вершина в миллиарде пикселей от окна
+// во float смещается на десятки пикселей, и край планеты дрожал бы
+void Painter::draw(RenderWindow& w, const Bodies& b, const Camera& cm, const std::vector<char>* on) {
+
+    const Vector2u ws = w.getSize();
+    const double D = ws.x + ws.y;
+    va.clear();
+
+    for (int i = 0; i < b.n; i++) {
+
+        if (on && !(*on)[i])
+            continue;
+
+        const double r = fmax(b.R[i] * cm.k, 2.5);
+        const double cx = cm.sx(b.x[i]), cy = cm.sy(b.y[i]);
+        if (cx + r < 0 || cy + r < 0 || cx - r > ws.x || cy - r > ws.y)
+            continue;
+
+        const Vertex c(Vector2f((float)cx, (float)cy), b.C[i]);
+
+        if (r > D) {
+            const double th = atan2(ws.y / 2.0 - cy, ws.x / 2.0 - cx), h = fmin(pi, 2 * D / r);
+            for (int j = 0; j < NS; j++) {
+                const double a = th - h + 2 * h * j / NS, e = a + 2 * h / NS;
+                va.append(c);
+                va.append(Vertex(Vector2f((float)(cx + r * cos(a)), (float)(cy + r * sin(a))), b.C[i]));
+                va.append(Vertex(Vector2f((float)(cx + r * cos(e)), (float)(cy + r * sin(e))), b.C[i]));
+            }
+            continue;
+        }
+
+        int st = NS / 8;
+        while (st > 1 && NS / st < r)
+            st /= 2;
+
+        for (int j = 0; j < NS; j += st) {
+            va.append(c);
+            va.append(Vertex(Vector2f((float)(cx + r * cs[j]), (float)(cy + r * sn[j])), b.C[i]));
+            va.append(Vertex(Vector2f((float)(cx + r * cs[j + st]), (float)(cy + r * sn[j + st])), b.C[i]));
+        }
+    }
+
+    w.draw(va);
+}
+
+// Следы тел ломаными в системе тела P: выборка тела i рисуется там, где она была
+// относительно P в тот же момент, последняя точка — текущее положение тела;
+// старые точки бледнее. Вершины пишутся в массивы, память которых остаётся;
+// кольцо занято только на их заполнение, отрисовка идёт без него
+void Painter::trails(RenderWindow& w, Trails& tr, const Bodies& b, int P, const Camera& cm) {
+
+    std::unique_lock<std::mutex> lk(tr.mx);
+
+    tl.resize(tr.n, VertexArray(LineStrip));
+
+    const int m = (int)std::min<long long>(tr.cnt, tr.K), n = tr.n;
+    const double px = cm.sx(b.x[P]), py = cm.sy(b.y[P]), k = cm.k;
+
+    for (int i = 0; i < n; i++) {
+
+        VertexArray& l = tl[i];
+        l.clear();
+
+        if (i == P || m == 0)
+            continue;
+
+        for (int s = 0; s < m; s++) {
+            const size_t r = (size_t)((tr.cnt - m + s) % tr.K) * n;
+            Color c = b.C[i];
+            c.a = (Uint8)(255 * (s + 1) / m);
+            l.append(Vertex(Vector2f((float)(px + (tr.x[r + i] - tr.x[r + P]) * k), (float)(py + (tr.y[r + i] - tr.y[r + P]) * k)), c));
+        }
+        l.append(Vertex(Vector2f((float)(px + (b.x[i] - b.x[P]) * k), (float)(py + (b.y[i] - b.y[P]) * k)), b.C[i]));
+    }
+
+    lk.unlock();
+
+    for (VertexArray& l : tl)
+        if (l.getVertexCount() > 1)
+            w.draw(l);
+}
+
+// Выделение кольца следов для тел до РН включительно
+void Trails::init(const Bodies& b) {
+    n = std::min(b.n, ROCKET + 1);
+    x.assign((size_t)K * n, 0);
+    y.assign((size_t)K * n, 0);
+    cnt = 0;
+    tn = 0;
+}
+
+// Выборка координат тел в момент t: не чаще шага dt, кольцо перезаписывает старые
+void Trails::put(const Bodies& b, double t) {
+
+    if (t < tn || n == 0)
+        return;
+
+    std::lock_guard<std::mutex> lk(mx);
+    const size_t r = (size_t)(cnt % K) * n;
+    for (int i = 0; i < n; i++) {
+        x[r + i] = b.x[i];
+        y[r + i] = b.y[i];
+    }
+    cnt++;
+    tn = t + dt;
+}
+
+// Состояние тел между таблицами a и c, разделёнными временем h, с, в доле s:
+// координаты — кубическим полиномом Эрмита, скорости — линейно
+void blend(const Bodies& a, const Bodies& c, double s, double h, Bodies& o) {
+
+    const double s2 = s * s, s3 = s2 * s;
+    const double h00 = 2 * s3 - 3 * s2 + 1, h10 = (s3 - 2 * s2 + s) * h, h01 = 3 * s2 - 2 * s3, h11 = (s3 - s2) * h;
+
+    for (int i = 0; i < o.n; i++) {
+        o.x[i] = h00 * a.x[i] + h10 * a.Vx[i] + h01 * c.x[i] + h11 * c.Vx[i];
+        o.y[i] = h00 * a.y[i] + h10 * a.Vy[i] + h01 * c.y[i] + h11 * c.Vy[i];
+        o.Vx[i] = a.Vx[i] + (c.Vx[i] - a.Vx[i]) * s;
+        o.Vy[i] = a.Vy[i] + (c.Vy[i] - a.Vy[i]) * s;
+    }
+}
+
+// Начальные данные миссии
+void Mission::init() {
+
+    // Данные Солнца //
+
+    b.add(1.9885 * pow(10, 30), 6.9551 * pow(10, 8), 0, 0, 0, 0, 0, Color::Yellow);
+
+    // Данные планет: масса, радиус, перигелий орбиты на оси Y, скорость в перигелии //
+
+    // Меркурий
+    b.add(3.33022 * pow(10, 23), 2.4397 * pow(10, 6), b.x[SUN], b.y[SUN] + 4.6001009 * pow(10, 10), 4.736 * pow(10, 4), 0, 1 << SUN, Color(120, 120, 120));
+
+    // Венера
+    b.add(4.8675 * pow(10, 24), 6.0518 * pow(10, 6), b.x[SUN], b.y[SUN] + 1.07476259 * pow(10, 11), 3.502 * pow(10, 4), 0, 1 << SUN, Color(255, 219, 139));
+
+    // Земля
+    b.add(5.9726 * pow(10, 24), 6.371 * pow(10, 6), b.x[SUN], b.y[SUN] + 1.4709829 * pow(10, 11), 2.9783 * pow(10, 4), 0, 1 << SUN, Color(0, 128, 255));
+
+    // Марс
+    b.add(6.4171 * pow(10, 23), 3.3895 * pow(10, 6), b.x[SUN], b.y[SUN] + 2.06655 * pow(10, 11), 2.4077 * pow(10, 4), 0, 1 << SUN, Color::Red);
+
+    // Юпитер
+    b.add(1.8986 * pow(10, 27), 6.9911 * pow(10, 7), b.x[SUN], b.y[SUN] + 7.405736 * pow(10, 11), 1.307 * pow(10, 4), 0, 1 << SUN, Color(245, 245, 220));
+
+    // Сатурн
+    b.add(5.6846 * pow(10, 26), 5.8232 * pow(10, 7), b.x[SUN], b.y[SUN] + 1.353572956 * pow(10, 12), 9.69 * pow(10, 3), 0, 1 << SUN, Color(166, 166, 0));
+
+    // Уран
+    b.add(8.6813 * pow(10, 25), 2.5362 * pow(10, 7), b.x[SUN], b.y[SUN] + 2.748938461 * pow(10, 12), 6.81 * pow(10, 3), 0, 1 << SUN, Color(0, 128, 128));
+
+    // Нептун
+    b.add(1.0243 * pow(10, 26), 2.4622 * pow(10, 7), b.x[SUN], b.y[SUN] + 4.452940833 * pow(10, 12), 5.4349 * pow(10, 3), 0, 1 << SUN, Color(70, 130, 180));
+
+    // Данные Луны: перигей орбиты над Землёй, скорость относительно Земли //
+
+    b.add(7.3477 * pow(10, 22), 1.7971 * pow(10, 6), b.x[EARTH], b.y[EARTH] + 3.63104 * pow(10, 8), b.Vx[EARTH] + 1.023 * pow(10, 3), b.Vy[EARTH], 1 << SUN | 1 << EARTH, Color::Black);
+
+    Stage Ein, Zwei, Drei, Rb, A;
+
+    // Данные первой ступени //
+
+    Ein.Ms = 15136;
+    Ein.M = 177562;
+    Ein.Mt = Ein.M - Ein.Ms;
+    Ein.Tm = 3354;
+    Ein.Tp = 4085.2;
+    Ein.Im = 2582.973;
+    Ein.Ip = 3141.162;
+
+    // Данные второй ступени //
+
+    Zwei.Ms = 6545;
+    Zwei.M = 99765;
+    Zwei.Mt = Zwei.M - Zwei.Ms;
+    Zwei.Tm = 792.5;
+    Zwei.Tp = 990.2;
+    Zwei.Im = 2528.037;
+    Zwei.Ip = 3145.086;
+
+    // Данные третьей ступени //
+
+    Drei.Ms = 2355;
+    Drei.M = 27755;
+    Drei.Mt = Drei.M - Drei.Ms;
+    Drei.Tp = 294.3;
+    Drei.Ip = 3521.79;
+
+    // Данные разгонного блока //
+
+    Rb.Ms = 887;
+    Rb.M = 6280;
+    Rb.Mt = Rb.M - Rb.Ms;
+    Rb.Tm = 19.9;
+    Rb.Tp = 19.9;
+    Rb.Im = 3268.692;
+    Rb.Ip = 3268.692;
+
+    // Площади миделя: с боковыми блоками, с головным обтекателем, разгонный блок, аппарат
+    Ein.S = 29.4;
+    Zwei.S = 10.8;
+    Drei.S = 10.8;
+    Rb.S = 5.7;
+
+    // Данные аппарата //
+
+    A.Ms = 605;
+    A.M = 1605;
+    A.Mt = A.M - A.Ms;
+    A.Tm = 4.7072;
+    A.Tp = 4.7072;
+    A.Im = 3103.457;
+    A.Ip = 3103.457;
+    A.S = 1;
+
+    stg = { Ein, Zwei, Drei, Rb, A };
+
+    // Данные РН: старт с поверхности Земли //
+
+    b.add(0, 0, b.x[EARTH], b.y[EARTH] + b.R[EARTH], b.Vx[EARTH] + Vrot, b.Vy[EARTH], 1 << SUN | 1 << EARTH | 1 << LUNA, Color::Green);
+
+    // Параметры первой ступени для рассчётов и полная масса РН
+    load(0);
+
+    // Таблица атмосферы Земли
+    auto a = std::make_shared<Atmosphere>();
+    a->build(G * b.M[EARTH], b.R[EARTH]);
+    atm = a;
+}
+
+// Планеты на юлианскую дату jd по средним элементам орбит на J2000 с вековым ходом,
+// без наклонов — в плоскости эклиптики; ось X эклиптики идёт по оси Y модели.
+// Луна и РН сдвигаются вместе с Землёй, и окна манёвров остаются в силе
+void Mission::epoch(double jd) {
+
+    // Большая полуось, а.е., эксцентриситет, средняя долгота и долгота перигелия, град,
+    // за каждым — изменение за столетие
+    static const double El[8][8] = {
+        { 0.38709927, 0.00000037, 0.20563593, 0.00001906, 252.25032350, 149472.67411175, 77.45779628, 0.16047689 },
+        { 0.72333566, 0.00000390, 0.00677672, -0.00004107, 181.97909950, 58517.81538729, 131.60246718, 0.00268329 },
+        { 1.00000261, 0.00000562, 0.01671123, -0.00004392, 100.46457166, 35999.37244981, 102.93768193, 0.32327364 },
+        { 1.52371034, 0.00001847, 0.09339410, 0.00007882, -4.55343205, 19140.30268499, -23.94362959, 0.44441088 },
+        { 5.20288700, -0.00011607, 0.04838624, -0.00013253, 34.39644051, 3034.74612775, 14.72847983, 0.21252668 },
+        { 9.53667594, -0.00125060, 0.05386179, -0.00050991, 49.95424423, 1222.49362201, 92.59887831, -0.41897216 },
+        { 19.18916464, -0.00196176, 0.04725744, -0.00004397, 313.23810451, 428.48202785, 170.95427630, 0.40805281 },
+        { 30.06992276, 0.00026291, 0.00859048, 0.00005105, -55.12002969, 218.45945325, 44.96476227, -0.32241464 }
+    };
+
+    // Астрономическая единица, м
+    const double au = 1.495978707 * pow(10, 11);
+
+    // Время от эпохи J2000, столетий
+    const double T = (jd - 2451545) / 36525;
+
+    const double x0 = b.x[EARTH], y0 = b.y[EARTH], vx0 = b.Vx[EARTH], vy0 = b.Vy[EARTH];
+
+    for (int i = MERCURY; i <= NEPTUNE; i++) {
+
+        const double* q = El[i - MERCURY];
+        double a = (q[0] + q[1] * T) * au;
+        double ec = q[2] + q[3] * T;
+        double L = (q[4] + q[5] * T) * pi / 180;
+        double w = (q[6] + q[7] * T) * pi / 180;
+
+        // Эксцентрическая аномалия по уравнению Кеплера методом Ньютона
+        double M = fmod(L - w, 2 * pi);
+        double E = M;
+        for (int k = 0; k < 10; k++)
+            E -= (E - ec * sin(E) - M) / (1 - ec * cos(E));
+
+        // Положение и скорость в плоскости орбиты, перигелий на оси X
+        double n = sqrt(G * (b.M[SUN] + b.M[i]) / (a * a * a));
+        double dE = n / (1 - ec * cos(E));
+        double k = sqrt(1 - ec * ec);
+        double px = a * (cos(E) - ec), py = a * k * sin(E);
+        double pvx = -a * sin(E) * dE, pvy = a * k * cos(E) * dE;
+
+        // Поворот на долготу перигелия
+        double cw = cos(w), sw = sin(w);
+        b.x[i] = b.x[SUN] + px * sw + py * cw;
+        b.y[i] = b.y[SUN] + px * cw - py * sw;
+        b.Vx[i] = b.Vx[SUN] + pvx * sw + pvy * cw;
+        b.Vy[i] = b.Vy[SUN] + pvx * cw - pvy * sw;
+    }
+
+    for (int i : { LUNA, ROCKET }) {
+        b.x[i] += b.x[EARTH] - x0;
+        b.y[i] += b.y[EARTH] - y0;
+        b.Vx[i] += b.Vx[EARTH] - vx0;
+        b.Vy[i] += b.Vy[EARTH] - vy0;
+    }
+
+    this->jd = jd;
+}
+
+// Один шаг интегрирования по времени
+void Mission::step() {
+
+    // Логика шага — всё время шага без перемещения и сил
+    Lap lp(pr);
+    const double f0 = pr ? pr->tf + pr->ti : 0;
+
+    // Первый шаг в режиме сфер действия
+    if (local() && fc < 0)
+        frame(dominant());
+
+    // Расстояния и направления РН //
+
+    rel();
+
+    // Высота РН над Землёй, м
+    double h = re - b.R[EARTH];
+
+    // Тяга двигателей //
+
+    // Давление, плотность, доля плотности уровня моря и скорость звука на высоте
+    double f;
+    atm->at(h, Pv, rv, f, Vs);
+
+    // Тяга двигателей на данной высоте, кН
+    Ts = Tpp - (Tpp - Tmm) * f;
+
+    // Удельная тяга твигателей на данной высоте, м/с
+    Is = Ipp - (Ipp - Imm) * f;
+
+    // Скоростной напор и его наибольшее значение
+    double vx, vy;
+    air(vx, vy);
+    Q = rv / 2 * (vx * vx + vy * vy);
+
+    if (Q > Qm) {
+        Qm = Q;
+        tQ = t;
+    }
+
+    if (hg == 0) {
+
+        // Ускорение РН от двигателей, м/с2
+        ad = Ts / b.M[ROCKET] * 1000;
+    }
+    else {
+        ad = 0;
+        Ts = 0;
+    }
+
+    // Длина шага: не дальше ближайшего события по времени и выгорания ступени //
+
+    // Когда все ускоряемые тела идут по Кеплеру, шаг длинный
+    double ht = coast() ? dk : dt;
+
+    // Шаг обрезан событием по времени, выгоранием топлива
+    bool ct = 0, cf = 0;
+
+    const double tn = next(t);
+    if (t + ht >= tn) {
+        ht = tn - t;
+        ct = 1;
+    }
+
+    // Расход топлива на шаге постоянен, момент выгорания находится точно
+    if (Ts > 0 && Mtt > 0 && Mtt < Ts / Is * 1000 * ht) {
+        ht = Mtt / (Ts / Is * 1000);
+        ct = 0;
+        cf = 1;
+    }
+
+    // Скорости и координаты всех тел //
+
+    // Состояние на начало шага для поиска момента события внутри шага
+    const double t0 = t;
+    double g0[4], g1[4];
+    events(g0);
+
+    // Снимок нужен, только если РН может дойти до поверхности события за шаг:
+    // её смещение относительно Земли или Луны не больше (v + a h) h
+    auto reach = [&](int j, double r) {
+        double v = norm(b.Vx[ROCKET] - b.Vx[j], b.Vy[ROCKET] - b.Vy[j]);
+        double a = G * b.M[j] / (r * r) + 5 * ad + 1;
+        return 2 * (v + a * ht) * ht;
+    };
+
+    const bool nearby = in == INT_BLOCK || g0[0] < reach(EARTH, re) || fmin(fmin(g0[1], g0[2]), g0[3]) < reach(LUNA, rl);
+
+    thread_local Snapshot m0;
+    if (nearby)
+        mark(m0);
+
+    auto crossed = [&]() {
+        for (int k = 0; k < 4; k++)
+            if (g0[k] > 0 && g1[k] <= 0)
+                return true;
+        return false;
+    };
+
+    // Возврат к началу шага, счётчик вычислений сил сохраняется
+    auto back = [&]() {
+        rewind(m0);
+    };
+
+    move(ht);
+    events(g1);
+
+    if (nearby && crossed()) {
+
+        if (in == INT_BLOCK) {
+
+            // Шаг РН делится пополам, пока событие не придётся на последний такт;
+            // если половина шага события не содержит, остаток пройдёт следующий шаг
+            long long s = sk[ROCKET];
+
+            while (s > 1) {
+                back();
+                kc = s / 2;
+                move(ht);
+                kc = 0;
+                events(g1);
+                if (!crossed())
+                    break;
+                s = sk[ROCKET];
+            }
+        }
+        else {
+
+            // Бисекция по длине шага
+            double lo = 0, hi = ht;
+
+            while (hi - lo > te) {
+                double md = (lo + hi) / 2;
+                back();
+                move(md);
+                events(g1);
+                if (crossed())
+                    hi = md;
+                else
+                    lo = md;
+            }
+
+            back();
+            move(hi);
+
+            if (hi < ht)
+                ct = cf = 0;
+        }
+    }
+
+    // Точное время события и полное выгорание без ошибок округления
+    if (ct && in != INT_BLOCK)
+        t = tn;
+    if (cf)
+        Mtt = 0;
+
+    // Событие по времени tv наступило на этом шаге
+    auto at = [&](double tv) { return t0 < tv && tv <= t; };
+
+
+    // Сброс ступени, если кончилось топливо; у последней двигатели выключаются
+    if (Mtt <= 0) {
+        if (s + 1 < (int)stg.size())
+            load(++s);
+        else
+            Tpp = Tmm = 0;
+    }
+
+    // Получение нужной скорости на орбите Земли
+    if (re - b.R[EARTH] >= 180000 && hg == 0 && t <= w1) {
+
+        hg = 1;
+
+        double vx = b.Vx[ROCKET], vy = b.Vy[ROCKET];
+
+        b.Vy[ROCKET] = b.Vy[EARTH] - 7800.650602 * uxe;
+        b.Vx[ROCKET] = b.Vx[EARTH] + 7800.650602 * uye;
+
+        ie = norm(b.Vx[ROCKET] - vx, b.Vy[ROCKET] - vy);
+    }
+
+    // Расчёт первого импульса для полёта к Луне
+    if (at(t1)) {
+
+        hg = 0;
+
+        // Отношение радиусов орбит перехода
+        double q = (rl + b.R[LUNA] + 100000) / re;
+
+        Vg1 = norm((b.Vx[ROCKET] - b.Vx[EARTH]), (b.Vy[ROCKET] - b.Vy[EARTH])) * (sqrt(2 * q / (q + 1)) - 1);
+    }
+
+    // Реализация первого импульса для полёта к Луне
+    if (t >= t1 && t < t2) {
+        dV += ad * ds;
+        if (dV >= Vg1 * kg) {
+            hg = 1;
+            dV = 0;
+        }
+    }
+
+    // Расчёт второго импульса для выхода на орбиту Луны 100 км
+    if (at(t2)) {
+        hg = 0;
+
+        // Круговая скорость на текущем расстоянии от Луны и отношение радиусов орбит
+        double vk = sqrt(G * b.M[LUNA] / rl);
+        double q = (b.R[LUNA] + 100000) / rl;
+
+        Vg2 = fabs(vk * (sqrt(2 * q / (q + 1)) - 1));
+        Vg2 += fabs(norm((b.Vx[ROCKET] - b.Vx[LUNA]), (b.Vy[ROCKET] - b.Vy[LUNA])) - vk);
+    }
+
+    // Реализация второго импульса для выхода на орбиту Луны 100 км
+    if (t >= t2 && t < w2) {
+        dV += ad * ds;
+        if (dV >= Vg2 * k2) {
+            hg = 1;
+            dV = 0;
+        }
+    }
+    
+    // Выход аппарата на орбиту Луны 100 км
+    if (rl - b.R[LUNA] <= 100000 && t <= w3) {
+
+        double vx = b.Vx[ROCKET], vy = b.Vy[ROCKET];
+
+        b.Vy[ROCKET] = b.Vy[LUNA] - 1607.80548 * uxl;
+        b.Vx[ROCKET] = b.Vx[LUNA] + 1607.80548 * uyl;
+
+        if (!ol) {
+            ol = 1;
+            il = norm(b.Vx[ROCKET] - vx, b.Vy[ROCKET] - vy);
+        }
+    }
+    
+    // Расчёт третьего импульса для снижения низшей точки орбиты до 18 км
+    if (at(t3)) {
+        hg = 0;
+
+        // Отношение радиусов орбит
+        double q = (b.R[LUNA] + 18000) / rl;
+
+        Vg3 = fabs(norm((b.Vx[ROCKET] - b.Vx[LUNA]), (b.Vy[ROCKET] - b.Vy[LUNA])) * (sqrt(2 * q / (q + 1)) - 1));
+    }
+
+    // Реализация третьего импульса для снижения низшей точки орбиты до 18 км
+    if (t >= t3 && t < w4) {
+        dV += ad * ds;
+        if (dV >= Vg3 * k3) {
+            hg = 1;
+            dV = 0;
+        }
+    }
+
+    if (t >= t4) {
+
+        if (at(t4)) {
+            hg = 0;
+        }
+        if (rl - b.R[LUNA] > 6100) {
+            if ((b.Vx[ROCKET] - b.Vx[LUNA]) * uyl + (b.Vy[ROCKET] - b.Vy[LUNA]) * uxl <= 1) {
+                st = 1;
+                hg = 1;
+            }
+        }
+        
+        if (rl - b.R[LUNA] <= 6100) {
+            if (fabs((b.Vx[ROCKET] - b.Vx[LUNA]) * uxl + (b.Vy[ROCKET] - b.Vy[LUNA]) * uyl) >= 2)
+                hg = 0;
+            else
+                hg = 1;
+        }
+    }
+
+    if (rl - b.R[LUNA] < hm)
+        hm = rl - b.R[LUNA];
+
+    // Посадка на Луну
+    if (rl - b.R[LUNA] <= 0 && !land) {
+        land = 1;
+        vt = norm(b.Vx[ROCKET] - b.Vx[LUNA], b.Vy[ROCKET] - b.Vy[LUNA]);
+    }
+
+    if (pr) {
+        pr->tl += lp.lap() - (pr->tf + pr->ti - f0);
+        pr->ns++;
+    }
+}
+
+// Шаг h со сменой времени, расстояний до РН и расходом топлива
+void Mission::move(double h) {
+
+    // Интегрирование — время перемещения без сил
+    Lap lp(pr);
+    const double f0 = pr ? pr->tf : 0;
+
+    const int n = b.n;
+
+    // Состояния тел, идущих по Кеплеру, относительно центральных тел на начало шага
+    thread_local std::vector<double> kx, ky, kvx, kvy;
+    const bool kep = kl && (int)kb.size() == n;
+
+    if (kep) {
+        kx.resize(n);
+        ky.resize(n);
+        kvx.resize(n);
+        kvy.resize(n);
+        for (int i = 0; i < n; i++) {
+            if (kb[i] >= 0) {
+                kx[i] = b.x[i] - b.x[kb[i]];
+                ky[i] = b.y[i] - b.y[kb[i]];
+                kvx[i] = b.Vx[i] - b.Vx[kb[i]];
+                kvy[i] = b.Vy[i] - b.Vy[kb[i]];
+            }
+        }
+    }
+
+    // Тела из кэша: ускорение берётся на начало шага, силы считаются только для остальных
+    ne = cached(t, t + h);
+
+    if (ne) {
+        if ((int)fr.size() != n - ne) {
+            fr.clear();
+            for (int i = ne; i < n; i++)
+                fr.push_back(i);
+        }
+        eph->at(t, b, 0);
+    }
+
+    // При блочных шагах время ведёт сам шаг РН
+    if (in != INT_BLOCK)
+        t += h;
+
+    integrate(h);
+
+    // Состояния тел из кэша на конец шага
+    if (ne)
+        eph->at(t, b, 1);
+    ne = 0;
+
+    // Толчок возмущением и перенос по Кеплеру от нового положения центрального тела;
+    // центральное тело имеет меньший индекс и к этому моменту уже перемещено
+    if (kep) {
+        for (int i = 0; i < n; i++) {
+
+            if (kb[i] < 0)
+                continue;
+
+            double x = kx[i], y = ky[i];
+            double vx = kvx[i] + kax[i] * h, vy = kvy[i] + kay[i] * h;
+
+            if (!kepler(km[i], x, y, vx, vy, h))
+                continue;
+
+            const int c = kb[i];
+            b.x[i] = b.x[c] + x;
+            b.y[i] = b.y[c] + y;
+            b.Vx[i] = b.Vx[c] + vx;
+            b.Vy[i] = b.Vy[c] + vy;
+        }
+    }
+
+    // Смена системы отсчёта РН на границе сферы действия
+    if (local()) {
+        int c = dominant();
+        if (c != fc)
+            frame(c);
+    }
+
+    // Расстояния после перемещения, направления остаются на начало шага
+    double dx, dy;
+    dist(EARTH, dx, dy);
+    re = norm(dx, dy);
+    dist(LUNA, dx, dy);
+    rl = norm(dx, dy);
+
+    // Массовый расход топлива, кг/с
+    b.M[ROCKET] -= Ts / Is * 1000 * ds;
+    Mtt -= Ts / Is * 1000 * ds;
+
+    if (pr)
+        pr->ti += lp.lap() - (pr->tf - f0);
+}
+
+// Снимок состояния, которое меняет перемещение
+void Mission::mark(Snapshot& c) const {
+    c.x = b.x;
+    c.y = b.y;
+    c.Vx = b.Vx;
+    c.Vy = b.Vy;
+    c.ax = b.ax;
+    c.ay = b.ay;
+    c.t = t;
+    c.ds = ds;
+    c.M = b.M[ROCKET];
+    c.Mtt = Mtt;
+    c.hf = hf;
+    c.re = re;
+    c.rl = rl;
+    c.ex = ex;
+    c.ey = ey;
+    c.lx = lx;
+    c.ly = ly;
+    c.fc = fc;
+    c.ga = ga;
+    c.nk = nk;
+    c.tb = tb;
+    c.sk = sk;
+    c.nx = nx;
+    c.pax = pax;
+    c.pay = pay;
+    c.jr = jr;
+    c.pend = pend;
+}
+
+// Возврат к снимку c
+void Mission::rewind(const Snapshot& c) {
+    b.x = c.x;
+    b.y = c.y;
+    b.Vx = c.Vx;
+    b.Vy = c.Vy;
+    b.ax = c.ax;
+    b.ay = c.ay;
+    t = c.t;
+    ds = c.ds;
+    b.M[ROCKET] = c.M;
+    Mtt = c.Mtt;
+    hf = c.hf;
+    re = c.re;
+    rl = c.rl;
+    ex = c.ex;
+    ey = c.ey;
+    lx = c.lx;
+    ly = c.ly;
+    fc = c.fc;
+    ga = c.ga;
+    nk = c.nk;
+    tb = c.tb;
+    sk = c.sk;
+    nx = c.nx;
+    pax = c.pax;
+    pay = c.pay;
+    jr = c.jr;
+    pend = c.pend;
+}
+
+// Ближайшее событие по времени после t: начала импульсов и границы окон, с
+double Mission::next(double t) {
+
+    const double tf[] = { w1, t1, t2, w2, w3, t3, w4, t4 };
+    double tn = 1e300;
+
+    for (double f : tf)
+        if (f > t && f < tn)
+            tn = f;
+
+    return tn;
+}
+
+// Тела, идущие на шаге по Кеплеру. Всё ускорение тела относительно центрального,
+// кроме притяжения задачи двух тел, — возмущение; центральное тело выбирается из
+// первых 32 тел с меньшим индексом по наименьшей доле возмущения, которая должна
+// быть меньше kp. Так Луна идёт вокруг Земли, хотя Солнце притягивает её сильнее.
+// Выбор делается в начале участка полёта РН без тяги, дальше на каждом шаге
+// только пересчитываются возмущения, и тело ищет новое центральное тело, лишь
+// когда доля возмущения дошла до kp. Перенос по Кеплеру идёт только длинным шагом:
+// на шаге dt он дороже численного. Возвращает 1, если численно идут только тела
+// без ускорения
+bool Mission::coast() {
+
+    const int n = b.n;
+
+    // РН с тягой, в атмосфере или в своей системе отсчёта идёт численно, шаг
+    // короткий, и выбор центральных тел ждёт следующего участка
+    if (kp <= 0 || in == INT_BLOCK || ad > 0 || rv > 0 || local()) {
+        kb.clear();
+        kl = 0;
+        return 0;
+    }
+
+    // После шага, на котором не всем телам нашлось центральное тело, поиск
+    // повторяется на границе отрезка dk по времени, а шаги до неё — численные
+    if ((int)kb.size() == n && !kl && floor(t / dk) == floor((t - ds) / dk))
+        return 0;
+
+    if ((int)kb.size() != n) {
+        kb.assign(n, -1);
+        km.assign(n, 0);
+        kax.assign(n, 0);
+        kay.assign(n, 0);
+    }
+
+    force();
+    ga = 1;
+
+    // Доля возмущения тела i при центральном теле j, параметр пары и возмущение
+    auto pert = [&](int i, int j, double& mu, double& px, double& py) {
+
+        // Центральное тело тоже притягивается к данному, кроме масок без этого бита
+        mu = G * b.M[j];
+        if (gm != GRAV_MASK || b.mk[j] >> i & 1)
+            mu += G * b.M[i];
+
+        double dx = b.x[i] - b.x[j], dy = b.y[i] - b.y[j], r = norm(dx, dy);
+        px = b.ax[i] - b.ax[j] + mu * dx / (r * r * r);
+        py = b.ay[i] - b.ay[j] + mu * dy / (r * r * r);
+        return norm(px, py) / (mu / (r * r));
+    };
+
+    bool all = 1;
+
+    // Тела из кэша не переносятся и длинному шагу не мешают
+    const int nc = cached(t, t);
+
+    for (int i = 0; i < n; i++) {
+
+        if (i < nc || (b.ax[i] == 0 && b.ay[i] == 0)) {
+            kb[i] = -1;
+            continue;
+        }
+
+        // Прежнее центральное тело, пока возмущение мало
+        double mu, px, py;
+        if (kb[i] >= 0 && pert(i, kb[i], mu, px, py) < kp) {
+            km[i] = mu;
+            kax[i] = px;
+            kay[i] = py;
+            continue;
+        }
+
+        // Центральное тело с наименьшей долей возмущения
+        int c = -1;
+        double ec = kp;
+
+        for (int j = 0; j < i && j < 32; j++) {
+
+            if (b.M[j] <= 0 || (gm == GRAV_MASK && !(b.mk[i] >> j & 1)))
+                continue;
+
+            double ep = pert(i, j, mu, px, py);
+
+            if (ep < ec) {
+                ec = ep;
+                c = j;
+                km[i] = mu;
+                kax[i] = px;
+                kay[i] = py;
+            }
+        }
+
+        if (c < 0)
+            all = 0;
+
+        kb[i] = c;
+    }
+
+    kl = all;
+    return all;
+}
+
+// Число первых тел, идущих по кэшу на отрезке времени от t0 до t1: блочные шаги
+// ведут каждое тело своим шагом, и кэш с ними не работает
+int Mission::cached(double t0, double t1) {
+    if (!eph || in == INT_BLOCK || !eph->has(t0) || !eph->has(t1))
+        return 0;
+    return eph->hd.nb;
+}
+
+// Факт работы режима сфер действия: положение РН относительно центра ведут
+// дрейфы, поэтому схемы Рунге — Кутты и блочные шаги идут как обычно
+bool Mission::local() {
+    return soi && (in == INT_EULER || in == INT_LEAP || in == INT_YOSHIDA);
+}
+
+// Тело, в сфере действия которого находится РН: радиус сферы действия
+// тела массы m около тела массы M на расстоянии a равен a (m / M)^0.4
+int Mission::dominant() {
+
+    double dx, dy;
+
+    if (sl == 0) {
+        sl = pow(b.M[LUNA] / b.M[EARTH], 0.4);
+        se = pow(b.M[EARTH] / b.M[SUN], 0.4);
+    }
+
+    dist(LUNA, dx, dy);
+    if (norm(dx, dy) < norm(b.x[LUNA] - b.x[EARTH], b.y[LUNA] - b.y[EARTH]) * sl)
+        return LUNA;
+
+    dist(EARTH, dx, dy);
+    if (norm(dx, dy) < norm(b.x[EARTH] - b.x[SUN], b.y[EARTH] - b.y[SUN]) * se)
+        return EARTH;
+
+    return SUN;
+}
+
+// Перенос центра системы отсчёта РН на тело c
+void Mission::frame(int c) {
+
+    if (fc < 0) {
+        lx = b.x[ROCKET] - b.x[c];
+        ly = b.y[ROCKET] - b.y[c];
+    }
+    else {
+        lx += b.x[fc] - b.x[c];
+        ly += b.y[fc] - b.y[c];
+    }
+
+    fc = c;
+    b.x[ROCKET] = b.x[c] + lx;
+    b.y[ROCKET] = b.y[c] + ly;
+}
+
+// Вектор от тела j до РН, м; в своей системе отсчёта — без вычитания
+// больших гелиоцентрических координат
+void Mission::dist(int j, double& dx, double& dy) {
+
+    if (!local() || fc < 0) {
+        dx = b.x[ROCKET] - b.x[j];
+        dy = b.y[ROCKET] - b.y[j];
+    }
+    else if (j == fc) {
+        dx = lx;
+        dy = ly;
+    }
+    else {
+        dx = b.x[fc] - b.x[j] + lx;
+        dy = b.y[fc] - b.y[j] + ly;
+    }
+}
+
+// Функции событий по состоянию: высота 180 км над Землёй при выведении,
+// высота 100 км над Луной до выхода на её орбиту, высота 6100 м при посадке
+// и касание поверхности Луны
+void Mission::events(double* g) {
+    g[0] = hg == 0 && t <= w1 ? b.R[EARTH] + 180000 - re : 1e300;
+    g[1] = t <= w3 ? rl - b.R[LUNA] - 100000 : 1e300;
+    g[2] = t >= t4 ? rl - b.R[LUNA] - 6100 : 1e300;
+    g[3] = rl - b.R[LUNA];
+}
+
+// Ускорения всех тел в текущем состоянии: тяготение и тяга РН
+void Mission::accel() {
+
+    if (!ga)
+        force(ne ? &fr : nullptr);
+    ga = 0;
+
+    // Притяжение РН по положению относительно центра её системы отсчёта:
+    // прямое притяжение центра и третьих тел; косвенный член — ускорение
+    // самого центра — входит через его скорость при дрейфе
+    if (local() && fc >= 0) {
+
+        double gx = 0, gy = 0;
+
+        for (int j = 0; j < b.n; j++) {
+
+            if (j == ROCKET || b.M[j] <= 0 || (gm == GRAV_MASK && (j >= 32 || !(b.mk[ROCKET] >> j & 1))))
+                continue;
+
+            double dx, dy;
+            dist(j, dx, dy);
+            double r2 = dx * dx + dy * dy;
+            double g = G * b.M[j] / (r2 * sqrt(r2));
+            gx -= g * dx;
+            gy -= g * dy;
+        }
+
+        b.ax[ROCKET] = gx;
+        b.ay[ROCKET] = gy;
+    }
+
+    double ax, ay;
+    jet(ax, ay);
+
+    b.ax[ROCKET] += ax;
+    b.ay[ROCKET] += ay;
+}
+
+// Начало замера
+Lap::Lap(Profile* p, double Profile::* c) : p(p), c(c) {
+    if (p)
+        t0 = std::chrono::steady_clock::now();
+}
+
+// Конец замера
+Lap::~Lap() {
+    if (p && c)
+        p->*c += lap();
+}
+
+// Время от начала замера, с
+double Lap::lap() const {
+    return p ? std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() : 0;
+}
+
+// Ускорения тяготения тел act со счётом вычислений сил и их времени
+void Mission::force(const std::vector<int>* act) {
+    Lap lp(pr, &Profile::tf);
+    gravity(b, gm, th, act);
+    nf += act ? act->size() : b.n;
+}
+
+// Ускорение РН от двигателей и сопротивления воздуха в текущем положении, м/с2
+void Mission::jet(double& ax, double& ay) {
+
+    ax = 0;
+    ay = 0;
+
+    // Сопротивление воздуха: 0,5 rho v^2 Cd S против скорости относительно воздуха
+    {
+        double dx, dy;
+        dist(EARTH, dx, dy);
+
+        double P, rho, f, a;
+        atm->at(norm(dx, dy) - b.R[EARTH], P, rho, f, a);
+
+        if (rho > 0) {
+            double vx, vy;
+            air(vx, vy);
+            double v = norm(vx, vy);
+            const Stage& sg = stage();
+            double k = rho / 2 * v * sg.S * sg.cd(v / a) / b.M[ROCKET];
+            ax -= k * vx;
+            ay -= k * vy;
+        }
+    }
+
+    if (ad == 0)
+        return;
+
+    // Направления на РН в текущем положении
+    double dx, dy;
+    dist(EARTH, dx, dy);
+    double r = norm(dx, dy);
+    double uxe = dx / r, uye = dy / r, h = r - b.R[EARTH];
+
+    dist(LUNA, dx, dy);
+    r = norm(dx, dy);
+
+    double uxl = dx / r, uyl = dy / r;
+
+    // Направление тяги РН //
+
+    // Множитель тяги при посадке
+    double kt = 1;
+
+    if (h < 20000) {
+
+        // Вертикальный подъём
+        ex = uxe;
+        ey = uye;
+    }
+    else if (t < t1) {
+
+        // Линейный поворот тяги до горизонта к высоте 180 км
+        double beta = clamp(pi / 2 * h / 180000, 0, pi / 2);
+        double cb = cos(beta), sb = sin(beta);
+
+        ex = uxe * cb + uye * sb;
+        ey = uye * cb - uxe * sb;
+    }
+    else if (t >= t1 && t < t2) {
+
+        // По скорости относительно Земли
+        double vx = b.Vx[ROCKET] - b.Vx[EARTH], vy = b.Vy[ROCKET] - b.Vy[EARTH], v = norm(vx, vy);
+        double sg = uye >= 0 ? 1 : -1;
+
+        ex = sg * fabs(vx) / v;
+        ey = vy / v;
+    }
+    else if (t >= t2 && t < t3) {
+
+        // Против скорости относительно Луны
+        double vx = b.Vx[ROCKET] - b.Vx[LUNA], vy = b.Vy[ROCKET] - b.Vy[LUNA], v = norm(vx, vy);
+        double sg = uyl >= 0 ? 1 : -1;
+
+        ex = -sg * fabs(vx) / v;
+        ey = -vy / v;
+    }
+    else if (t >= t3 && !st) {
+
+        // По касательной к поверхности Луны
+        ex = -uyl;
+        ey = uxl;
+
+        if (t >= t4)
+            kt = 5;
+    }
+    else {
+
+        // Вертикально от Луны
+        ex = uxl;
+        ey = uyl;
+    }
+
+    // Пределы дросселирования работающей ступени
+    const Stage& sg = stage();
+    if (sg.Kmax > 0)
+        kt = clamp(kt, sg.Kmin, sg.Kmax);
+
+    ax += kt * ad * ex;
+    ay += kt * ad * ey;
+}
+
+// Скорость РН относительно воздуха, вращающегося вместе с Землёй, м/с
+void Mission::air(double& vx, double& vy) {
+
+    double dx, dy;
+    dist(EARTH, dx, dy);
+
+    // Угловая скорость вращения Земли, рад/с: на старте поверхность движется по оси X
+    double w = -Vrot / b.R[EARTH];
+
+    vx = b.Vx[ROCKET] - b.Vx[EARTH] + w * dy;
+    vy = b.Vy[ROCKET] - b.Vy[EARTH] - w * dx;
+}
+
+// Работающая ступень
+const Stage& Mission::stage() {
+    return stg[s < (int)stg.size() ? s : stg.size() - 1];
+}
+
+// Параметры ступени k для рассчётов и масса РН со ступенями от k-й
+void Mission::load(int k) {
+    const Stage& g = stg[k];
+    Mtt = g.Mt;
+    Tpp = g.Tp;
+    Tmm = g.Tm;
+    Ipp = g.Ip;
+    Imm = g.Im;
+
+    double M = 0;
+    for (size_t j = k; j < stg.size(); j++)
+        M += stg[j].M;
+    b.M[ROCKET] = M;
+}
+
+// Все поля состояния по порядку для контрольной точки: тела, ступени, тяга,
+// время, схема и её внутреннее состояние, импульсы и признаки этапов полёта
+template <class A>
+void Mission::io(A& a) {
+
+    a(b.n);
+    a(b.M);
+    a(b.R);
+    a(b.x);
+    a(b.y);
+    a(b.Vx);
+    a(b.Vy);
+    a(b.ax);
+    a(b.ay);
+    a(b.mk);
+    a(b.C);
+
+    a(stg);
+    a(s);
+    a(Tmm);
+    a(Tpp);
+    a(Imm);
+    a(Ipp);
+    a(Mtt);
+    a(Ts);
+    a(Is);
+    a(Pv);
+    a(rv);
+    a(Vs);
+    a(Q);
+    a(Qm);
+    a(tQ);
+    a(jd);
+    a(ad);
+    a(ex);
+    a(ey);
+    a(re);
+    a(rl);
+    a(uxe);
+    a(uye);
+    a(uxl);
+    a(uyl);
+
+    a(t);
+    a(dt);
+    a(ds);
+    a(gm);
+    a(in);
+    a(tol);
+    a(hf);
+    a(th);
+    a(dtmax);
+    a(eta);
+    a(nk);
+    a(tb);
+    a(sk);
+    a(nx);
+    a(pax);
+    a(pay);
+    a(jr);
+    a(pend);
+    a(nf);
+    a(kp);
+    a(dk);
+    a(kb);
+    a(km);
+    a(kax);
+    a(kay);
+    a(kl);
+    a(ga);
+    a(soi);
+    a(fc);
+    a(lx);
+    a(ly);
+    a(sl);
+    a(se);
+
+    a(hg);
+    a(Vg1);
+    a(Vg2);
+    a(Vg3);
+    a(dV);
+    a(t1);
+    a(t2);
+    a(t3);
+    a(t4);
+    a(w1);
+    a(w2);
+    a(w3);
+    a(w4);
+    a(te);
+    a(kc);
+    a(st);
+    a(land);
+    a(kg);
+    a(k2);
+    a(k3);
+    a(hm);
+    a(ie);
+    a(il);
+    a(ol);
+    a(vt);
+}
+
+// Запись контрольной точки: метка, версия и поля состояния
+bool Mission::save(const char* fn) {
+
+    std::ofstream fs(fn, std::ios::binary);
+    if (!fs)
+        return 0;
+
+    fs.write(chkTag, sizeof chkTag);
+    uint32_t v = chkVer;
+    fs.write((const char*)&v, sizeof v);
+
+    Archive a;
+    a.os = &fs;
+    io(a);
+
+    return (bool)fs;
+}
+
+// Восстановление из контрольной точки; при ошибке состояние не меняется
+bool Mission::restore(const char* fn) {
+
+    std::ifstream fs(fn, std::ios::binary);
+    char tag[8];
+    uint32_t v = 0;
+    if (!fs.read(tag, sizeof tag) || memcmp(tag, chkTag, sizeof tag) != 0 || !fs.read((char*)&v, sizeof v) || v != chkVer)
+        return 0;
+
+    Mission c = *this;
+    Archive a;
+    a.is = &fs;
+    c.io(a);
+
+    // Все массивы тел одной длины, РН на месте
+    const size_t n = c.b.n;
+    const Bodies& q = c.b;
+    if (!fs || fs.peek() != EOF || c.b.n <= ROCKET || q.M.size() != n || q.R.size() != n || q.x.size() != n || q.y.size() != n
+        || q.Vx.size() != n || q.Vy.size() != n || q.ax.size() != n || q.ay.size() != n || q.mk.size() != n || q.C.size() != n
+        || c.stg.empty())
+        return 0;
+
+    // Ступень, система отсчёта РН, модель тяготения и схема в своих пределах
+    if (c.s < 0 || c.s >= (int)c.stg.size() || c.fc < -1 || c.fc >= (int)n || c.gm < GRAV_MASK || c.gm > GRAV_TREE
+        || c.in < INT_EULER || c.in > INT_BLOCK)
+        return 0;
+
+    // Блочные шаги: массивы одной длины — ноль или число тел, шаги положительны,
+    // ждущие тела есть в таблице
+    const size_t nb = c.sk.size();
+    if ((nb != 0 && nb != n) || c.nx.size() != nb || c.pax.size() != nb || c.pay.size() != nb || c.jr.size() != nb)
+        return 0;
+    for (long long k : c.sk)
+        if (k < 1)
+            return 0;
+    for (int i : c.pend)
+        if (i < 0 || i >= (int)n)
+            return 0;
+
+    // Перенос по Кеплеру: массивы одной длины — ноль или число тел, центральное
+    // тело — -1 или тело с меньшим индексом
+    const size_t nk = c.kb.size();
+    if ((nk != 0 && nk != n) || c.km.size() != nk || c.kax.size() != nk || c.kay.size() != nk)
+        return 0;
+    for (size_t i = 0; i < nk; i++)
+        if (c.kb[i] < -1 || c.kb[i] >= (int)i)
+            return 0;
+
+    *this = c;
+    return 1;
+}
+
+// Время первого импульса для режима расчёта. Схемы по-разному копят ошибку за час
+// на орбите Земли, и при чужом t1 посадка уходит на полчаса и больше или РН проходит
+// мимо Луны; t1 подобраны перебором через 1 с, для переноса по Кеплеру — через 0,2 с.
+// Для режимов вне таблицы остаётся t1 схемы Эйлера с шагом 0,25 с
+void Mission::burns() {
+
+    // Схема, шаг, с, порог возмущения и шаг переноса по Кеплеру, с, и t1, с;
+    // блочные шаги перенос по Кеплеру не используют
+    struct Mode {
+        int in;
+        double dt, kp, dk, t1;
+    };
+    static const Mode md[] = {
+        { INT_EULER, 0.25, 0, 0, 3586 },
+        { INT_EULER, 1, 0, 0, 3594 },
+        { INT_EULER, 0.25, 0.01, 100, 3571.6 },
+        { INT_LEAP, 0.25, 0, 0, 3587 },
+        { INT_YOSHIDA, 0.25, 0, 0, 3587 },
+        { INT_RK4, 0.25, 0, 0, 3588 },
+        { INT_RKF45, 0.25, 0, 0, 3588 },
+        { INT_BLOCK, 0.25, 0, 0, 3588 }
+    };
+
+    const double k = in == INT_BLOCK ? 0 : kp;
+
+    for (const Mode& d : md) {
+        if (d.in == in && d.dt == dt && d.kp == k && (k <= 0 || d.dk == dk)) {
+            t1 = d.t1;
+            return;
+        }
+    }
+}
+
+// Таблица ступеней из файла: по строке на ступень снизу вверх
+// «имя Ms M Tm Tp Im Ip S [Kmin Kmax]»; строка «cd Ma Cd Ma Cd ...» — от 2 до 9
+// узлов кривой сопротивления предыдущей ступени по возрастанию числа Маха;
+// после # — комментарий. Строка с лишними, нечисловыми или недопустимыми
+// полями — ошибка
+bool Mission::vehicle(const char* fn) {
+    std::ifstream fs(fn);
+    if (!fs)
+        return 0;
+
+    // Число из всего слова w
+    auto num = [](const std::string& w, double& x) {
+        char* e;
+        x = strtod(w.c_str(), &e);
+        return e != w.c_str() && *e == 0 && std::isfinite(x);
+    };
+
+    std::vector<Stage> v;
+    std::string ln;
+    while (std::getline(fs, ln)) {
+        size_t c = ln.find('#');
+        if (c != std::string::npos)
+            ln.erase(c);
+
+        std::istringstream ss(ln);
+        std::vector<std::string> w;
+        for (std::string x; ss >> x;)
+            w.push_back(x);
+        if (w.empty())
+            continue;
+
+        std::vector<double> f(w.size() - 1);
+        for (size_t i = 1; i < w.size(); i++)
+            if (!num(w[i], f[i - 1]))
+                return 0;
+
+        // Кривая сопротивления: числа Маха растут, последний узел продолжается
+        // до конца таблицы
+        if (w[0] == "cd") {
+            const int k = (int)f.size() / 2;
+            if (v.empty() || f.size() % 2 != 0 || k < 2 || k > 9)
+                return 0;
+            Stage& g = v.back();
+            for (int i = 0; i < 9; i++) {
+                const int j = std::min(i, k - 1);
+                if (f[2 * j] < 0 || f[2 * j + 1] < 0 || (i > 0 && i < k && f[2 * j] <= g.Ma[i - 1]))
+                    return 0;
+                g.Ma[i] = f[2 * j];
+                g.Cd[i] = f[2 * j + 1];
+            }
+            continue;
+        }
+
+        if (f.size() != 7 && f.size() != 9)
+            return 0;
+
+        Stage g;
+        g.Ms = f[0];
+        g.M = f[1];
+        g.Tm = f[2];
+        g.Tp = f[3];
+        g.Im = f[4];
+        g.Ip = f[5];
+        g.S = f[6];
+        if (g.M <= g.Ms || g.Ms < 0)
+            return 0;
+
+        // Тяга и площадь не отрицательны, при тяге удельный импульс положителен
+        if (g.Tm < 0 || g.Tp < 0 || g.Im < 0 || g.Ip < 0 || g.S < 0 || (g.Tm > 0 && g.Im <= 0) || (g.Tp > 0 && g.Ip <= 0))
+            return 0;
+
+        // Необязательные пределы тяги
+        if (f.size() == 9) {
+            if (f[7] < 0 || f[8] < f[7])
+                return 0;
+            g.Kmin = f[7];
+            g.Kmax = f[8];
+        }
+
+        g.Mt = g.M - g.Ms;
+        v.push_back(g);
+    }
+
+    if (v.empty())
+        return 0;
+
+    stg = v;
+    s = 0;
+    load(0);
+    return 1;
+}
+
+// Перемещение всех тел на шаг h выбранной схемой
+void Mission::integrate(double h) {
+
+    ds = h;
+
+    switch (in) {
+    case INT_LEAP:
+        leapfrog(h);
+        break;
+    case INT_YOSHIDA:
+        yoshida(h);
+        break;
+    case INT_RK4:
+        rk4(h);
+        break;
+    case INT_RKF45:
+        rkf45(h);
+        break;
+    case INT_BLOCK:
+        block();
+        break;
+    default:
+
+        // Полунеявный Эйлер: сначала скорости, затем координаты
+        accel();
+        kick(h);
+        drift(h);
+        break;
+    }
+}
+
+// Дрейф координат всех тел на время h
+void Mission::drift(double h) {
+    ga = 0;
+    for (int i = 0; i < b.n; i++) {
+        b.x[i] += b.Vx[i] * h;
+        b.y[i] += b.Vy[i] * h;
+    }
+
+    // РН дрейфует относительно центра своей системы отсчёта
+    if (local() && fc >= 0) {
+        lx += (b.Vx[ROCKET] - b.Vx[fc]) * h;
+        ly += (b.Vy[ROCKET] - b.Vy[fc]) * h;
+        b.x[ROCKET] = b.x[fc] + lx;
+        b.y[ROCKET] = b.y[fc] + ly;
+    }
+}
+
+// Толчок скоростей всех тел на время h по текущим ускорениям
+void Mission::kick(double h) {
+    for (int i = 0; i < b.n; i++) {
+        b.Vx[i] += b.ax[i] * h;
+        b.Vy[i] += b.ay[i] * h;
+    }
+}
+
+// Блочные шаги (толчок — дрейф — толчок): тело i идёт шагом sk[i] тактов длиной dt,
+// sk[i] — степень двойки, и такт начала шага кратен sk[i]; дрейфуют все тела,
+// толчок и вычисление сил только у тел, закончивших шаг. Возврат в конце шага РН
+void Mission::block() {
+
+    const int n = b.n;
+
+    // Первый вызов: все тела синхронны и начинают шаг
+    if ((int)sk.size() != n) {
+        nk = 0;
+        tb = t;
+        sk.assign(n, 1);
+        nx.assign(n, 0);
+        pax.assign(n, 0);
+        pay.assign(n, 0);
+        jr.assign(n, -1);
+        pend.clear();
+        for (int i = 0; i < n; i++)
+            pend.push_back(i);
+        force();
+    }
+
+    // Тела, закончившие шаг вместе с РН, начинают новый уже с новой тягой
+    open(pend);
+
+    thread_local std::vector<int> act;
+
+    while (true) {
+
+        // Ближайший такт конца шага
+        long long n1 = nx[0];
+        for (int i = 1; i < n; i++)
+            if (nx[i] < n1)
+                n1 = nx[i];
+
+        drift((n1 - nk) * dt);
+        nk = n1;
+        t = tb + nk * dt;
+
+        act.clear();
+        for (int i = 0; i < n; i++)
+            if (nx[i] == nk)
+                act.push_back(i);
+
+        force(&act);
+
+        // Завершающий полутолчок и скорость изменения ускорения за шаг
+        bool rk = 0;
+
+        for (int i : act) {
+
+            double ax = b.ax[i], ay = b.ay[i];
+
+            if (i == ROCKET) {
+                double jx, jy;
+                jet(jx, jy);
+                ax += jx;
+                ay += jy;
+                rk = 1;
+            }
+
+            double h = sk[i] * dt;
+            b.Vx[i] += ax * h / 2;
+            b.Vy[i] += ay * h / 2;
+            jr[i] = norm(ax - pax[i], ay - pay[i]) / h;
+        }
+
+        if (rk) {
+            pend = act;
+            ds = sk[ROCKET] * dt;
+            return;
+        }
+
+        open(act);
+    }
+}
+
+// Выбор шага и начальный полутолчок тел из списка act на текущем такте
+void Mission::open(const std::vector<int>& act) {
+
+    // Наибольший шаг в тактах
+    long long sm = 1;
+    while (2 * sm * dt <= dtmax)
+        sm *= 2;
+
+    // Ближайший такт, на котором шаг РН обязан закончиться: событие по времени
+    long long ne = nk + sm;
+    double k = ceil((next(t) - tb) / dt - 1e-9);
+
+    if (k < ne)
+        ne = (long long)k;
+
+    // Шаг по ускорению a и скорости его изменения, не длиннее lim тактов
+    auto level = [&](int i, double a, long long lim) {
+        double h = jr[i] > 0 ? eta * a / jr[i] : jr[i] < 0 ? dt : dtmax;
+        long long s = 1;
+        while (2 * s <= lim && 2 * s * dt <= h && nk % (2 * s) == 0)
+            s *= 2;
+        return s;
+    };
+
+    // РН выбирает шаг первой: Земля и Луна не переходят конец её шага,
+    // чтобы в конце шага РН их скорости были синхронны
+    thread_local std::vector<int> ord;
+    ord.clear();
+    for (int i : act)
+        if (i == ROCKET)
+            ord.push_back(i);
+    for (int i : act)
+        if (i != ROCKET)
+            ord.push_back(i);
+
+    for (int i : ord) {
+
+        double ax = b.ax[i], ay = b.ay[i];
+        long long s;
+
+        if (i == ROCKET) {
+
+            double jx, jy;
+            jet(jx, jy);
+            ax += jx;
+            ay += jy;
+
+            // При работе двигателей шаг базовый: сброс ступеней остаётся на границе шага
+            s = ad > 0 ? 1 : level(i, norm(ax, ay), ne - nk);
+
+            // Поиск события внутри шага
+            if (kc > 0 && s > kc)
+                s = kc;
+        }
+        else if (i == EARTH || i == LUNA) {
+            s = level(i, norm(ax, ay), nx[ROCKET] - nk);
+        }
+        else {
+            s = level(i, norm(ax, ay), sm);
+        }
+
+        sk[i] = s;
+        nx[i] = nk + s;
+        pax[i] = ax;
+        pay[i] = ay;
+
+        b.Vx[i] += ax * s * dt / 2;
+        b.Vy[i] += ay * s * dt / 2;
+    }
+}
+
+// Чехарда (дрейф — толчок — дрейф), 2-й порядок, одно вычисление сил за шаг
+void Mission::leapfrog(double h) {
+    drift(h / 2);
+    accel();
+    kick(h);
+    drift(h / 2);
+}
+
+// Симплектическая схема Иошиды 4-го порядка из трёх шагов чехарды
+void Mission::yoshida(double h) {
+
+    const double w1 = 1 / (2 - cbrt(2.0));
+    const double w0 = 1 - 2 * w1;
+
+    drift(w1 / 2 * h);
+    accel();
+    kick(w1 * h);
+    drift((w0 + w1) / 2 * h);
+    accel();
+    kick(w0 * h);
+    drift((w0 + w1) / 2 * h);
+    accel();
+    kick(w1 * h);
+    drift(w1 / 2 * h);
+}
+
+// Классический метод Рунге — Кутты 4-го порядка
+void Mission::rk4(double h) {
+
+    static const double A[6][6] = {
+        { 0 },
+        { 1.0 / 2 },
+        { 0, 1.0 / 2 },
+        { 0, 0, 1 }
+    };
+    static const double B[6] = { 1.0 / 6, 1.0 / 3, 1.0 / 3, 1.0 / 6 };
+
+    rk(4, A, B, nullptr, h);
+}
+
+// Метод Рунге — Кутты — Фельберга 4(5) с выбором внутреннего шага по ошибке tol
+void Mission::rkf45(double h) {
+
+    static const double A[6][6] = {
+        { 0 },
+        { 1.0 / 4 },
+        { 3.0 / 32, 9.0 / 32 },
+        { 1932.0 / 2197, -7200.0 / 2197, 7296.0 / 2197 },
+        { 439.0 / 216, -8, 3680.0 / 513, -845.0 / 4104 },
+        { -8.0 / 27, 2, -3544.0 / 2565, 1859.0 / 4104, -11.0 / 40 }
+    };
+
+    // Решение 5-го порядка и разность решений 5-го и 4-го порядков
+    static const double B[6] = { 16.0 / 135, 0, 6656.0 / 12825, 28561.0 / 56430, -9.0 / 50, 2.0 / 55 };
+    static const double E[6] = { 16.0 / 135 - 25.0 / 216, 0, 6656.0 / 12825 - 1408.0 / 2565, 28561.0 / 56430 - 2197.0 / 4104, -9.0 / 50 + 1.0 / 5, 2.0 / 55 };
+
+    // Состояние на начало внутреннего шага для отката
+    thread_local std::vector<double> x0, y0, vx0, vy0;
+
+    // Оставшееся время шага, с
+    double rest = h;
+
+    if (hf <= 0 || hf > h)
+        hf = h;
+
+    while (rest > 0) {
+
+        double q = hf < rest ? hf : rest;
+
+        x0 = b.x;
+        y0 = b.y;
+        vx0 = b.Vx;
+        vy0 = b.Vy;
+
+        double err = rk(6, A, B, E, q) / tol;
+
+        if (err <= 1 || q < h * 1e-6) {
+            rest -= q;
+            hf = q * clamp(0.9 * pow(err + 1e-12, -0.2), 1, 4);
+            if (hf > h)
+                hf = h;
+        }
+        else {
+            b.x = x0;
+            b.y = y0;
+            b.Vx = vx0;
+            b.Vy = vy0;
+            hf = q * clamp(0.9 * pow(err, -0.25), 0.1, 1);
+        }
+    }
+}
+
+// Шаг явного метода Рунге — Кутты на время h по таблице Бутчера A, весам B
+// и весам оценки ошибки E; возвращает наибольшую ошибку положения тела, м
+double Mission::rk(int ns, const double A[][6], const double* B, const double* E, double h) {
+
+    const int n = b.n;
+
+    // Начальное состояние и производные на стадиях: скорости и ускорения
+    thread_local std::vector<double> x0, y0, vx0, vy0;
+    thread_local std::vector<double> K[6][4];
+
+    x0 = b.x;
+    y0 = b.y;
+    vx0 = b.Vx;
+    vy0 = b.Vy;
+
+    for (int s = 0; s < ns; s++) {
+
+        // Состояние на стадии s
+        if (s > 0) {
+            for (int i = 0; i < n; i++) {
+                double dx = 0, dy = 0, dvx = 0, dvy = 0;
+                for (int j = 0; j < s; j++) {
+                    dx += A[s][j] * K[j][0][i];
+                    dy += A[s][j] * K[j][1][i];
+                    dvx += A[s][j] * K[j][2][i];
+                    dvy += A[s][j] * K[j][3][i];
+                }
+                b.x[i] = x0[i] + h * dx;
+                b.y[i] = y0[i] + h * dy;
+                b.Vx[i] = vx0[i] + h * dvx;
+                b.Vy[i] = vy0[i] + h * dvy;
+            }
+        }
+
+        accel();
+
+        K[s][0] = b.Vx;
+        K[s][1] = b.Vy;
+        K[s][2] = b.ax;
+        K[s][3] = b.ay;
+    }
+
+    // Итоговое состояние и оценка ошибки
+    double err = 0;
+
+    for (int i = 0; i < n; i++) {
+
+        double dx = 0, dy = 0, dvx = 0, dvy = 0;
+        for (int j = 0; j < ns; j++) {
+            dx += B[j] * K[j][0][i];
+            dy += B[j] * K[j][1][i];
+            dvx += B[j] * K[j][2][i];
+            dvy += B[j] * K[j][3][i];
+        }
+        b.x[i] = x0[i] + h * dx;
+        b.y[i] = y0[i] + h * dy;
+        b.Vx[i] = vx0[i] + h * dvx;
+        b.Vy[i] = vy0[i] + h * dvy;
+
+        if (E) {
+
+            // Ошибка положения и ошибка скорости, приведённая к шагу
+            double ex = 0, ey = 0, evx = 0, evy = 0;
+            for (int j = 0; j < ns; j++) {
+                ex += E[j] * K[j][0][i];
+                ey += E[j] * K[j][1][i];
+                evx += E[j] * K[j][2][i];
+                evy += E[j] * K[j][3][i];
+            }
+            err = fmax(err, h * (norm(ex, ey) + h * norm(evx, evy)));
+        }
+    }
+
+    return err;
+}
+
+// Расчёт расстояний и направлений РН относительно Земли и Луны
+void Mission::rel() {
+
+    double dx, dy;
+    dist(EARTH, dx, dy);
+    re = norm(dx, dy);
+    uxe = dx / re;
+    uye = dy / re;
+
+    dist(LUNA, dx, dy);
+    rl = norm(dx, dy);
+    uxl = dx / rl;
+    uyl = dy / rl;
+}
+
+// Расчёт миссии без окна до времени tk или до посадки на Луну
+int headless(Mission& m, double tk, Recorder* rec, const char* qf, long long qn) {
+
+    // Число шагов интегрирования
+    long long n = 0;
+
+    // Счётчики профилирования и их значения на начало строки
+    Profile q, q0;
+    std::ofstream os;
+    if (qf) {
+        os.open(qf);
+        if (!os) {
+            std::cerr << "Luna: не удалось открыть файл " << qf << std::endl;
+            return 1;
+        }
+        os << "t,s,steps,wall_s,steps_per_s,force_ms,integrate_ms,logic_ms,other_ms\n";
+        os.precision(10);
+        m.pr = &q;
+        if (qn < 1)
+            qn = 1;
+    }
+
+    auto c0 = std::chrono::steady_clock::now();
+    double w0 = 0;
+
+    // Строка счётчиков за шаги от предыдущей строки; прочее — запись траектории и цикл
+    auto row = [&](double w) {
+        double dw = w - w0, df = q.tf - q0.tf, di = q.ti - q0.ti, dl = q.tl - q0.tl;
+        os << m.t << ',' << m.s << ',' << q.ns << ',' << w << ',' << (dw > 0 ? (q.ns - q0.ns) / dw : 0) << ','
+            << df * 1000 << ',' << di * 1000 << ',' << dl * 1000 << ',' << (dw - df - di - dl) * 1000 << '\n';
+        q0 = q;
+        w0 = w;
+    };
+
+    while (m.t < tk && !m.land) {
+        m.step();
+        n++;
+        if (rec)
+            rec->put(m);
+        if (qf && n % qn == 0)
+            row(std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count());
+    }
+
+    double w = std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count();
+
+    if (qf) {
+        if (n % qn != 0)
+            row(w);
+        m.pr = nullptr;
+    }
+
+    if (m.land)
+        std::cout << m.t - m.t4 << std::endl;
+
+    std::cout << "max Q = " << m.Qm << " Pa at t = " << m.tQ << " s" << std::endl;
+
+    std::cout << "t = " << m.t << " s, " << n << " steps, " << m.nf << " force evaluations, " << w << " s, " << n / w << " steps/s" << std::endl;
+
+    return 0;
+}
+
+// Равномерное число в (0, 1) генератором splitmix64 с состоянием q:
+// зёрна подряд дают независимые ряды
+double uniform(unsigned long long& q) {
+    unsigned long long z = (q += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return ((z >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Выполнение f(k) для k от 0 до N - 1 на nt потоках: потоки берут номера по очереди
+template <class F>
+void pool(int N, int nt, F f) {
+
+    std::atomic<int> nx{ 0 };
+    auto work = [&]() {
+        solo = 1;
+        for (int k; (k = nx++) < N;)
+            f(k);
+    };
+
+    std::vector<std::thread> th;
+    for (int i = 0; i < nt && i < N; i++)
+        th.emplace_back(work);
+    for (std::thread& t : th)
+        t.join();
+}
+
+// Разброс параметров миссии m по нормальному закону: тяга и удельный импульс
+// каждой ступени, её сухая масса и масса топлива, времена импульсов и запас
+// первого импульса
+void disperse(Mission& m, const Dispersion& d, unsigned long long seed) {
+
+    unsigned long long q = seed;
+
+    // Нормальная величина по Боксу — Мюллеру
+    auto gauss = [&]() {
+        double u = uniform(q), v = uniform(q);
+        return sqrt(-2 * log(u)) * cos(2 * pi * v);
+    };
+
+    // Изменение массы РН: ступени выше работающей, сухая масса работающей и её
+    // оставшееся топливо
+    double dM = 0;
+
+    for (int j = 0; j < (int)m.stg.size(); j++) {
+        Stage& g = m.stg[j];
+        double kT = 1 + d.T * gauss(), kI = 1 + d.I * gauss(), kM = 1 + d.M * gauss();
+        double Mt = g.Mt * kM;
+        g.Tm *= kT;
+        g.Tp *= kT;
+        g.Im *= kI;
+        g.Ip *= kI;
+        double Ms = g.Ms * (1 + d.M * gauss());
+
+        // Миссия из контрольной точки: работающая ступень уже израсходовала часть
+        // топлива, её живые параметры меняются теми же множителями
+        if (j == m.s && m.t > 0) {
+            m.Tpp *= kT;
+            m.Tmm *= kT;
+            m.Ipp *= kI;
+            m.Imm *= kI;
+            dM += Ms - g.Ms + m.Mtt * (kM - 1);
+            m.Mtt *= kM;
+        }
+        else if (j > m.s)
+            dM += Ms + Mt - g.M;
+
+        g.Ms = Ms;
+        g.M = Ms + Mt;
+        g.Mt = Mt;
+    }
+
+    // Времена импульсов сдвигаются, пока импульс впереди
+    double dt1 = d.tb * gauss(), dt2 = d.tb * gauss(), dt3 = d.tb * gauss(), dt4 = d.tb * gauss();
+    if (m.t < m.t1)
+        m.t1 += dt1;
+    if (m.t < m.t2)
+        m.t2 += dt2;
+    if (m.t < m.t3)
+        m.t3 += dt3;
+    if (m.t < m.t4)
+        m.t4 += dt4;
+    m.kg *= 1 + d.kg * gauss();
+
+    if (m.t == 0)
+        m.load(m.s);
+    else
+        m.b.M[ROCKET] += dM;
+}
+
+// Спокойный шаг: его итог зависит только от движения РН в поле тел по маске, и его
+// можно считать сразу для многих миссий. Пересечение поверхности события проверяется
+// после шага
+bool Mission::calm() {
+
+    if (land || in != INT_EULER || gm != GRAV_MASK || local() || kp > 0 || ga || pr)
+        return 0;
+    if (b.n != ROCKET + 1 || cached(t, t + dt) != ROCKET)
+        return 0;
+    if (hg == 0 || dV != 0 || t >= t4 || t + dt >= next(t))
+        return 0;
+    if (Mtt <= 0 && (s + 1 < (int)stg.size() || Tpp != 0 || Tmm != 0))
+        return 0;
+
+    double P, rho, f, a;
+    atm->at(re - b.R[EARTH], P, rho, f, a);
+    return rho == 0;
+}
+
+// Добавление миссии в свободную полосу
+void Lanes::add(Mission* m, double te) {
+    c[nl] = m;
+    this->te[nl] = te;
+    nl++;
+}
+
+// Обычный шаг миссии полосы l; состояния тел вне J сначала берутся из кэша на её время
+void Lanes::single(int l) {
+    Mission& m = *c[l];
+    if (old[l]) {
+        m.eph->at(m.t, m.b, 1);
+        old[l] = 0;
+    }
+    m.step();
+    ns++;
+}
+
+// Расчёт полос: на каждом круге полосы со спокойным шагом идут вместе, остальные —
+// своим шагом. Действия над полосами совпадают с Mission::step для спокойного шага:
+// тяготение по маске в порядке тел, полунеявный Эйлер, состояния тел J на конец
+// шага по кэшу полиномами Эрмита, расстояния до Земли и Луны
+void Lanes::run() {
+
+    if (nl == 0)
+        return;
+
+    // Притягивающие тела общие у всех полос; без Земли и Луны среди них — по одной
+    const Bodies& b0 = c[0]->b;
+    const unsigned mk = b0.n > ROCKET ? b0.mk[ROCKET] : 0;
+    for (int j = 0; j < ROCKET && j < 32 && nj < NJ; j++) {
+        if (mk >> j & 1) {
+            if (j == EARTH)
+                je = nj;
+            if (j == LUNA)
+                jl = nj;
+            J[nj++] = j;
+        }
+    }
+    bool ok = je >= 0 && jl >= 0 && (mk >> ROCKET) == 0;
+    for (int l = 0; l < nl; l++)
+        ok = ok && c[l]->b.n == b0.n && c[l]->b.mk[ROCKET] == mk;
+
+    // Гравитационные параметры и радиусы Земли и Луны
+    double GM[NJ];
+    for (int j = 0; j < nj; j++)
+        GM[j] = G * b0.M[J[j]];
+    const double RE = b0.R[EARTH], RL = b0.R[LUNA];
+
+    // Состояния полос: время и шаг, РН, тела J
+    double t[W], h[W], x[W], y[W], vx[W], vy[W], ax[W], ay[W];
+    double jx[NJ][W], jy[NJ][W], jvx[NJ][W], jvy[NJ][W];
+
+    // Расстояния и единичные векторы на РН в начале и в конце шага
+    double re0[W], rl0[W], uxe[W], uye[W], uxl[W], uyl[W], re1[W], rl1[W];
+
+    while (true) {
+
+        bool q[W] = {}, any = 0;
+        int nc = 0;
+
+        for (int l = 0; l < nl; l++) {
+            Mission& m = *c[l];
+            if (m.land || m.t >= te[l])
+                continue;
+            any = 1;
+            q[l] = ok && m.calm();
+            if (q[l])
+                nc++;
+            else
+                single(l);
+        }
+
+        if (!any)
+            break;
+        if (nc == 0)
+            continue;
+
+        // Сбор полос — перестановка из миссий по одной полосе; у полос без
+        // спокойного шага — безвредные числа, и дальше все полосы считаются
+        // одинаково без ветвлений
+        for (int l = 0; l < nl; l++) {
+            t[l] = 0;
+            h[l] = 0;
+            x[l] = 1;
+            y[l] = 0;
+            vx[l] = 0;
+            vy[l] = 0;
+        }
+        for (int j = 0; j < nj; j++)
+            for (int l = 0; l < nl; l++) {
+                jx[j][l] = 0;
+                jy[j][l] = 0;
+                jvx[j][l] = 0;
+                jvy[j][l] = 0;
+            }
+        for (int l = 0; l < nl; l++) {
+            if (!q[l])
+                continue;
+            const Mission& m = *c[l];
+            t[l] = m.t;
+            h[l] = m.dt;
+            x[l] = m.b.x[ROCKET];
+            y[l] = m.b.y[ROCKET];
+            vx[l] = m.b.Vx[ROCKET];
+            vy[l] = m.b.Vy[ROCKET];
+            for (int j = 0; j < nj; j++) {
+                jx[j][l] = m.b.x[J[j]];
+                jy[j][l] = m.b.y[J[j]];
+                jvx[j][l] = m.b.Vx[J[j]];
+                jvy[j][l] = m.b.Vy[J[j]];
+            }
+        }
+
+        // Земля и Луна в полосах
+        const double* ex = jx[je];
+        const double* ey = jy[je];
+        const double* lx = jx[jl];
+        const double* ly = jy[jl];
+
+        // Направления на РН в начале шага
+        for (int l = 0; l < nl; l++) {
+            double dx = x[l] - ex[l], dy = y[l] - ey[l];
+            re0[l] = sqrt(dx * dx + dy * dy);
+            uxe[l] = dx / re0[l];
+            uye[l] = dy / re0[l];
+            dx = x[l] - lx[l];
+            dy = y[l] - ly[l];
+            rl0[l] = sqrt(dx * dx + dy * dy);
+            uxl[l] = dx / rl0[l];
+            uyl[l] = dy / rl0[l];
+        }
+
+        // Притяжение РН телами J, толчок и дрейф
+        for (int l = 0; l < nl; l++) {
+            ax[l] = 0;
+            ay[l] = 0;
+        }
+        for (int j = 0; j < nj; j++) {
+            for (int l = 0; l < nl; l++) {
+                double dx = x[l] - jx[j][l];
+                double dy = y[l] - jy[j][l];
+                double r2 = dx * dx + dy * dy;
+                double g = GM[j] / (r2 * sqrt(r2));
+                ax[l] -= g * dx;
+                ay[l] -= g * dy;
+            }
+        }
+        for (int l = 0; l < nl; l++) {
+            vx[l] += ax[l] * h[l];
+            vy[l] += ay[l] * h[l];
+            x[l] += vx[l] * h[l];
+            y[l] += vy[l] * h[l];
+            t[l] += h[l];
+        }
+
+        // Тела J на конец шага из кэша, как в Ephemeris::at: номер узла и
+        // базис Эрмита всех полос, затем выборка узлов по номерам полос
+        const Ephemeris& e = *c[0]->eph;
+        const double H = e.hd.h;
+        const int nb = e.hd.nb;
+        const double t0 = e.hd.t0;
+        const int kn = (int)(e.hd.ns - 2);
+        int kd[W];
+        double h00[W], h10[W], h01[W], h11[W];
+        long long o[W];
+        for (int l = 0; l < nl; l++) {
+            const double u = (t[l] - t0) / H;
+            int k = (int)u;
+            k = k < kn ? k : kn;
+            kd[l] = k > 0 ? k : 0;
+            const double s = u - kd[l], s2 = s * s, s3 = s2 * s;
+            h00[l] = 2 * s3 - 3 * s2 + 1;
+            h10[l] = (s3 - 2 * s2 + s) * H;
+            h01[l] = 3 * s2 - 2 * s3;
+            h11[l] = (s3 - s2) * H;
+        }
+        for (int l = 0; l < nl; l++)
+            o[l] = (long long)kd[l] * nb * 6;
+        for (int j = 0; j < nj; j++) {
+            const double* p = e.d + J[j] * 6;
+            const double* r = p + nb * 6;
+            for (int l = 0; l < nl; l++) {
+                jx[j][l] = h00[l] * p[o[l]] + h10[l] * p[o[l] + 2] + h01[l] * r[o[l]] + h11[l] * r[o[l] + 2];
+                jy[j][l] = h00[l] * p[o[l] + 1] + h10[l] * p[o[l] + 3] + h01[l] * r[o[l] + 1] + h11[l] * r[o[l] + 3];
+                jvx[j][l] = h00[l] * p[o[l] + 2] + h10[l] * p[o[l] + 4] + h01[l] * r[o[l] + 2] + h11[l] * r[o[l] + 4];
+                jvy[j][l] = h00[l] * p[o[l] + 3] + h10[l] * p[o[l] + 5] + h01[l] * r[o[l] + 3] + h11[l] * r[o[l] + 5];
+            }
+        }
+
+        // Расстояния до Земли и Луны в конце шага
+        for (int l = 0; l < nl; l++) {
+            double dx = x[l] - ex[l], dy = y[l] - ey[l];
+            re1[l] = sqrt(dx * dx + dy * dy);
+            dx = x[l] - lx[l];
+            dy = y[l] - ly[l];
+            rl1[l] = sqrt(dx * dx + dy * dy);
+        }
+
+        // Итог полосы принимается без пересечения поверхностей событий и выхода
+        // на орбиту Луны, иначе шаг повторяется миссией полосы
+        for (int l = 0; l < nl; l++) {
+
+            if (!q[l])
+                continue;
+
+            Mission& m = *c[l];
+            double g0[4], g1[4];
+            m.events(g0);
+            const double tm = m.t, rm = m.re, lm = m.rl;
+            m.t = t[l];
+            m.re = re1[l];
+            m.rl = rl1[l];
+            m.events(g1);
+            m.t = tm;
+            m.re = rm;
+            m.rl = lm;
+
+            bool cr = rl1[l] - RL <= 100000 && t[l] <= m.w3;
+            for (int k = 0; k < 4; k++)
+                cr = cr || (g0[k] > 0 && g1[k] <= 0);
+
+            if (cr) {
+                single(l);
+                continue;
+            }
+
+            double P, rho, f, a;
+            m.atm->at(re0[l] - RE, P, rho, f, a);
+            m.Pv = P;
+            m.rv = rho;
+            m.Vs = a;
+            m.Is = m.Ipp - (m.Ipp - m.Imm) * f;
+            m.Ts = 0;
+            m.ad = 0;
+            m.Q = 0;
+
+            m.uxe = uxe[l];
+            m.uye = uye[l];
+            m.uxl = uxl[l];
+            m.uyl = uyl[l];
+
+            m.t = t[l];
+            m.ds = h[l];
+            m.nf++;
+            m.b.x[ROCKET] = x[l];
+            m.b.y[ROCKET] = y[l];
+            m.b.Vx[ROCKET] = vx[l];
+            m.b.Vy[ROCKET] = vy[l];
+            m.b.ax[ROCKET] = ax[l];
+            m.b.ay[ROCKET] = ay[l];
+            for (int j = 0; j < nj; j++) {
+                m.b.x[J[j]] = jx[j][l];
+                m.b.y[J[j]] = jy[j][l];
+                m.b.Vx[J[j]] = jvx[j][l];
+                m.b.Vy[J[j]] = jvy[j][l];
+            }
+            m.re = re1[l];
+            m.rl = rl1[l];
+            if (m.rl - RL < m.hm)
+                m.hm = m.rl - RL;
+
+            old[l] = 1;
+            ns++;
+            nq++;
+        }
+    }
+}
+
+// Статистические испытания: N копий миссии m с разбросом параметров, миссия k
+// с зерном seed + k, на nt потоках; каждая идёт до посадки, до tk или до часа
+// после начала посадки. Итоги миссий — в файл fn, сводка — в стандартный вывод
+int montecarlo(const Mission& m, int N, int nt, int nw, unsigned long long seed, const Dispersion& d, double tk, const char* fn) {
+
+    // Итог одной миссии
+    struct Run {
+        bool land = 0;
+        double tl = 0, vt = 0, Mtt = 0, ie = 0, il = 0;
+    };
+
+    std::vector<Run> rs(N);
+
+    auto c0 = std::chrono::steady_clock::now();
+
+    // Миссии идут пачками по nw в полосах
+    nw = (int)clamp(nw, 1, Lanes::W);
+    std::atomic<long long> ns{ 0 }, nq{ 0 };
+
+    pool((N + nw - 1) / nw, nt, [&](int p) {
+
+        const int k0 = p * nw, k1 = std::min(N, k0 + nw);
+        std::vector<Mission> c(k1 - k0, m);
+        Lanes L;
+
+        for (int k = k0; k < k1; k++) {
+            Mission& ck = c[k - k0];
+            disperse(ck, d, seed + k);
+            L.add(&ck, fmin(tk, ck.t4 + 3600));
+        }
+        L.run();
+        ns += L.ns;
+        nq += L.nq;
+
+        for (int k = k0; k < k1; k++) {
+            const Mission& ck = c[k - k0];
+            Run& r = rs[k];
+            r.land = ck.land;
+            r.tl = ck.t - ck.t4;
+            r.vt = ck.vt;
+            r.Mtt = ck.Mtt;
+            r.ie = ck.ie;
+            r.il = ck.il;
+        }
+    });
+
+    double w = std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count();
+
+    std::ofstream fs(fn);
+    if (!fs) {
+        std::cerr << "Luna: не удалось записать " << fn << std::endl;
+        return 1;
+    }
+
+    fs << "run,seed,land,t_land,v_land,Mtt,dV_earth,dV_luna\n";
+    fs.precision(10);
+    for (int k = 0; k < N; k++) {
+        const Run& r = rs[k];
+        fs << k << ',' << seed + k << ',' << r.land << ',' << r.tl << ',' << r.vt << ',' << r.Mtt << ',' << r.ie << ',' << r.il << '\n';
+    }
+
+    // Сводка по севшим миссиям: среднее, отклонение и квантили
+    int nl = 0;
+    for (const Run& r : rs)
+        nl += r.land;
+
+    std::cout << N << " runs, " << nl << " landed (" << 100.0 * nl / N << " %), " << w << " s, " << N / w * 60 << " runs/min, " << (nt < N ? nt : N) << " threads" << std::endl;
+    std::cout << nw << " lanes, " << ns << " steps, " << 100.0 * nq / std::max(ns.load(), 1LL) << " % in lanes" << std::endl;
+
+    auto stat = [&](const char* name, double Run::* f) {
+        std::vector<double> v;
+        for (const Run& r : rs)
+            if (r.land)
+                v.push_back(r.*f);
+        if (v.empty())
+            return;
+
+        std::sort(v.begin(), v.end());
+        double s = 0, s2 = 0;
+        for (double x : v) {
+            s += x;
+            s2 += x * x;
+        }
+        double mean = s / v.size();
+        double sd = sqrt(fmax(s2 / v.size() - mean * mean, 0));
+        auto pc = [&](double p) { return v[(size_t)(p * (v.size() - 1) + 0.5)]; };
+
+        std::cout << name << ": mean " << mean << ", sd " << sd << ", min " << v.front() << ", p5 " << pc(0.05) << ", p50 " << pc(0.5) << ", p95 " << pc(0.95) << ", max " << v.back() << std::endl;
+    };
+
+    stat("t - t4, s", &Run::tl);
+    stat("touchdown speed, m/s", &Run::vt);
+    stat("propellant left, kg", &Run::Mtt);
+    stat("Earth orbit insertion dV, m/s", &Run::ie);
+    stat("Moon orbit insertion dV, m/s", &Run::il);
+
+    return 0;
+}
+
+// Поиск времён и величин импульсов дифференциальной эволюцией (rand/1/bin) в два этапа,
+// каждый от своего снимка миссии, до которого его параметры ещё не действуют:
+// перелёт — t1, kg, t2, k2 от конца окна выхода на орбиту Земли до выхода на орбиту Луны,
+// посадка — t3, k3, t4 от конца окна выхода на орбиту Луны лучшего перелёта.
+// Цель — наименьший скачок скорости при выходе на орбиту Луны и скорость посадки или,
+// при fuel, наименьшее топливо вместе с топливом на эти скачки. G поколений на этап
+int optimize(Mission m, int ng, int nt, unsigned long long seed, bool fuel, double tk) {
+
+    unsigned long long q = seed;
+
+    // Топливо всех оставшихся ступеней, кг
+    auto left = [](const Mission& c) {
+        double M = c.Mtt;
+        for (size_t j = c.s + 1; j < c.stg.size(); j++)
+            M += c.stg[j].Mt;
+        return M;
+    };
+
+    // Топливо, израсходованное от снимка c0, вместе с топливом на скачок скорости dv
+    auto spent = [&](const Mission& c0, const Mission& c, double dv) {
+        return left(c0) - left(c) + c.b.M[ROCKET] * (1 - exp(-dv / c.Ipp));
+    };
+
+    // Дифференциальная эволюция от снимка c0: D параметров в границах lo, hi,
+    // первая особь — x; set задаёт параметры копии, cost доводит её и оценивает
+    auto evolve = [&](const Mission& c0, int D, const double* lo, const double* hi, double* x, auto set, auto cost) {
+
+        const int NP = 8 * D;
+        const double F = 0.6, CR = 0.9;
+
+        std::vector<std::vector<double>> P(NP, std::vector<double>(D)), U = P;
+        std::vector<double> fp(NP), fu(NP);
+
+        // Особи около x: перелёт чувствителен к параметрам, и случайные особи
+        // по всей области почти все проходят мимо Луны
+        for (int i = 0; i < NP; i++)
+            for (int j = 0; j < D; j++)
+                P[i][j] = i == 0 ? x[j] : clamp(x[j] + (hi[j] - lo[j]) * 0.02 * (2 * uniform(q) - 1), lo[j], hi[j]);
+
+        auto eval = [&](std::vector<std::vector<double>>& X, std::vector<double>& f) {
+            pool(NP, nt, [&](int i) {
+                Mission c = c0;
+                set(c, X[i].data());
+                f[i] = cost(c);
+            });
+        };
+
+        eval(P, fp);
+
+        for (int g = 0; g < ng; g++) {
+
+            for (int i = 0; i < NP; i++) {
+                int a, b, c;
+                do a = (int)(uniform(q) * NP); while (a == i);
+                do b = (int)(uniform(q) * NP); while (b == i || b == a);
+                do c = (int)(uniform(q) * NP); while (c == i || c == a || c == b);
+                int jr = (int)(uniform(q) * D);
+                for (int j = 0; j < D; j++) {
+                    double v = P[a][j] + F * (P[b][j] - P[c][j]);
+                    U[i][j] = j == jr || uniform(q) < CR ? clamp(v, lo[j], hi[j]) : P[i][j];
                 }
             }
 
-            // Возврат камеры в изначальное положение
-            if (Keyboard::isKeyPressed(Keyboard::R)) {
-                dMx = 0;
-                dMy = 0;
-            }
+            eval(U, fu);
 
-            // При изменении размеров окна картинка не искажается
-            if (event.type == Event::Resized) {
-                FloatRect visibleArea(0.f, 0.f, event.size.width, event.size.height);
-                window.setView(View(visibleArea));
+            int ib = 0;
+            for (int i = 0; i < NP; i++) {
+                if (fu[i] <= fp[i]) {
+                    P[i] = U[i];
+                    fp[i] = fu[i];
+                }
+                if (fp[i] < fp[ib])
+                    ib = i;
             }
+
+            std::cout << "generation " << g + 1 << ": best " << fp[ib] << std::endl;
         }
 
-        // Измненение объекта, относительно которого происходит отрисовка
-        switch (P) {
-        case 0:
-            X = Sun.x;
-            Y = Sun.y;
-            break;
-        case 1:
-            X = Mercury.x;
-            Y = Mercury.y;
-            break;
-        case 2:
-            X = Venus.x;
-            Y = Venus.y;
-            break;
-        case 3:
-            X = Earth.x;
-            Y = Earth.y;
-            break;
-        case 4:
-            X = Mars.x;
-            Y = Mars.y;
-            break;
-        case 5:
-            X = Jupiter.x;
-            Y = Jupiter.y;
-            break;
-        case 6:
-            X = Saturn.x;
-            Y = Saturn.y;
-            break;
-        case 7:
-            X = Uran.x;
-            Y = Uran.y;
-            break;
-        case 8:
-            X = Neptune.x;
-            Y = Neptune.y;
-            break;
-        case 9:
-            X = Luna.x;
-            Y = Luna.y;
-            break;
-        case 10:
-            X = Rocket.x;
-            Y = Rocket.y;
-            break;
+        int ib = 0;
+        for (int i = 1; i < NP; i++)
+            if (fp[i] < fp[ib])
+                ib = i;
+        for (int j = 0; j < D; j++)
+            x[j] = P[ib][j];
+        return fp[ib];
+    };
+
+    auto c0 = std::chrono::steady_clock::now();
+
+    // Начальное состояние для проверки найденных параметров
+    const Mission m0 = m;
+
+    // Этап перелёта: снимок на конце окна выхода на орбиту Земли //
+
+    while (m.t < m.w1 && !m.land)
+        m.step();
+
+    double xa[4] = { m.t1, m.kg, m.t2, m.k2 };
+    const double la[4] = { m.t + 1, 0.95, m.w2 - 15000, 0.5 };
+    const double ha[4] = { m.t + 6000, 1.1, m.w2 - 100, 1.5 };
+
+    auto seta = [](Mission& c, const double* p) {
+        c.t1 = p[0];
+        c.kg = p[1];
+        c.t2 = p[2];
+        c.k2 = p[3];
+    };
+
+    // Без выхода на орбиту Луны — штраф по наименьшей высоте над Луной
+    auto costa = [&](Mission& c) {
+        while (c.t < c.w3 && !c.ol && !c.land)
+            c.step();
+        if (!c.ol)
+            return 1e6 + fmax(c.hm - 100000, 0) / 1000;
+        return fuel ? spent(m, c, c.il) : c.il;
+    };
+
+    double fa = evolve(m, 4, la, ha, xa, seta, costa);
+    seta(m, xa);
+
+    // Этап посадки: снимок лучшего перелёта на конце окна выхода на орбиту Луны //
+
+    while (m.t < m.w3 && !m.land)
+        m.step();
+    m.hm = 1e300;
+
+    double xb[3] = { m.t3, m.k3, m.t4 };
+    const double lb[3] = { m.t + 1, 0.5, m.w4 + 1 };
+    const double hb[3] = { m.w4 - 1, 1.5, m.w4 + 2000 };
+
+    auto setb = [](Mission& c, const double* p) {
+        c.t3 = p[0];
+        c.k3 = p[1];
+        c.t4 = p[2];
+    };
+
+    // Без посадки — штраф по наименьшей высоте над Луной
+    auto costb = [&](Mission& c) {
+        const double te = fmin(tk, c.t4 + 3600);
+        while (c.t < te && !c.land)
+            c.step();
+        if (!c.land)
+            return 1e6 + c.hm / 1000;
+        return fuel ? spent(m, c, c.vt) : c.vt;
+    };
+
+    double fb = evolve(m, 3, lb, hb, xb, setb, costb);
+
+    double w = std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count();
+
+    std::cout << "transfer cost " << fa << ", landing cost " << fb << ", " << w << " s" << std::endl;
+
+    // Проверка полным расчётом от начала миссии
+    Mission c = m0;
+    seta(c, xa);
+    setb(c, xb);
+    while (c.t < fmin(tk, c.t4 + 3600) && !c.land)
+        c.step();
+    if (c.land)
+        std::cout << "from start: t - t4 = " << c.t - c.t4 << " s, touchdown speed " << c.vt << " m/s, Moon orbit insertion dV " << c.il << " m/s" << std::endl;
+    else
+        std::cout << "from start: no landing" << std::endl;
+
+    std::cout.precision(17);
+    std::cout << "-burns " << xa[0] << ' ' << xa[2] << ' ' << xb[0] << ' ' << xb[2] << " -gains " << xa[1] << ' ' << xa[3] << ' ' << xb[1] << std::endl;
+
+    return 0;
+}
+
+// Поток расчёта: Tv шагов за такт с частотой 60 Гц независимо от отрисовки
+void worker(Mission m, Shared& sh, Recorder* rec) {
+
+    // Длительность такта, с
+    const std::chrono::duration<double> tick(1.0 / 60);
+
+    auto next = std::chrono::steady_clock::now();
+
+    // Счётчики профилирования расчёта
+    Profile q;
+    m.pr = &q;
+
+    while (sh.run) {
+
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(tick);
+
+        int n = sh.Tv;
+
+        for (int T = 0; T < n && !m.land; T++) {
+            m.step();
+
+            if (rec)
+                rec->put(m);
+
+            sh.tr.put(m.b, m.t);
+
+            if (m.land) {
+                sh.Tv = 0;
+                std::cout << m.t - m.t4 << std::endl;
+            }
         }
 
-        // Перемещение по окну
-        if (Tm % 2 != 0) {
-            Vector2i M = Mouse::getPosition(window);
-            dMx += M.x - Mx;
-            dMy += M.y - My;
-            Mx = M.x;
-            My = M.y;
+        // Запись в задний буфер и его публикация
+        q.nt++;
+        int b = 1 - sh.front;
+        sh.buf[b] = m;
+        {
+            std::lock_guard<std::mutex> lk(sh.mx);
+            sh.front = b;
+            sh.ts[b] = std::chrono::steady_clock::now();
+            sh.seq++;
+            sh.pf = q;
         }
 
-        // Чёрное пространство
-        window.clear(Color::White);
+        // Если расчёт не уложился в такт, следующий начинается сразу
+        auto now = std::chrono::steady_clock::now();
+        if (next > now)
+            std::this_thread::sleep_until(next);
+        else
+            next = now;
+    }
+}
 
-        // Отриовка Солнца
-        //CircleShape Sn(5.f);
-        CircleShape Sn(Sun.R * k);
-        Sn.setFillColor(Color::Yellow);
-        Sn.setPosition(width / 2 - (Sun.R + X) * k + dMx, height / 2 - (Sun.R + Y) * k + dMy);
-        //Sn.setPosition(width / 2 - 2.5f - X * k + dMx, height / 2 - 2.5f - Y * k + dMy);
+// Открытие файла записи траектории: заголовок со столбцами — время, ступень, код этапа,
+// тяга, кН, высоты над Землёй и Луной, м, скоростной напор, Па, затем для каждого
+// тела координаты, скорости и масса; начальное состояние — первая строка
+bool Recorder::open(const char* fn, const Mission& m, const std::vector<int>& bodies, long long N) {
+
+    for (int i : bodies)
+        if (i < 0 || i >= m.b.n)
+            return 0;
+
+    fs.open(fn, std::ios::binary);
+    if (!fs)
+        return 0;
+
+    bs = bodies;
+    this->N = N > 0 ? N : 1;
+
+    std::vector<std::string> cn = { "t", "stage", "phase", "Ts", "h", "hl", "Q" };
+    for (int i : bs)
+        for (const char* c : { "x", "y", "Vx", "Vy", "M" })
+            cn.push_back(c + std::to_string(i));
+    nc = (int)cn.size();
+
+    fs.write(recTag, sizeof recTag);
+    uint32_t v = recVer, k = nc;
+    fs.write((const char*)&v, sizeof v);
+    fs.write((const char*)&k, sizeof k);
+    for (const std::string& c : cn) {
+        char s[16] = {};
+        strncpy(s, c.c_str(), sizeof s - 1);
+        fs.write(s, sizeof s);
+    }
 
-        window.draw(Sn);
+    for (std::vector<double>& b : ring)
+        b.assign((size_t)nc * K, 0);
 
-        // Отрисовка объектов //
+    th = std::thread(&Recorder::writer, this);
 
-        int T = 0;
+    // Первая строка пишется до первого шага: расстояния и тяга на старте
+    // считаются на копии так же, как в начале шага
+    Mission c = m;
+    c.rel();
+    double P, rho, f, a;
+    c.atm->at(c.re - c.b.R[EARTH], P, rho, f, a);
+    c.Ts = c.hg == 0 ? c.Tpp - (c.Tpp - c.Tmm) * f : 0;
+    row(c);
+    return (bool)fs;
+}
 
-        while (T < Tv) {
+// Строка после шага: каждый N-й шаг и при смене ступени, работы двигателей
+// или этапа полёта
+void Recorder::put(const Mission& m) {
+    n++;
+    int p = m.s | m.hg << 8 | m.st << 9 | m.ol << 10 | m.land << 11;
+    if (n % N == 0 || p != ph)
+        row(m);
+}
 
-            t += dt;
+// Строка состояния миссии в заполняемый блок; полный блок уходит в очередь,
+// а если очередь полна, расчёт ждёт поток записи
+void Recorder::row(const Mission& m) {
+
+    ph = m.s | m.hg << 8 | m.st << 9 | m.ol << 10 | m.land << 11;
+
+    double* c = ring[wb].data() + (size_t)r * nc;
+    auto col = [&](double v) {
+        *c++ = v;
+    };
+
+    col(m.t);
+    col(m.s);
+    col(ph);
+    col(m.Ts);
+    col(m.re - m.b.R[EARTH]);
+    col(m.rl - m.b.R[LUNA]);
+    col(m.Q);
+    for (int i : bs) {
+        col(m.b.x[i]);
+        col(m.b.y[i]);
+        col(m.b.Vx[i]);
+        col(m.b.Vy[i]);
+        col(m.b.M[i]);
+    }
 
-            // Ускорения свободного падения //
+    if (++r < K)
+        return;
 
-            // РН
-            Rocket.gs = G * Sun.M / pow(norm((Rocket.x - Sun.x), (Rocket.y - Sun.y)), 2);
-            Rocket.gp = G * Earth.M / pow(norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)), 2);
-            Rocket.gl = G * Luna.M / pow(norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)), 2);
+    std::unique_lock<std::mutex> lk(mx);
+    full++;
+    cv.notify_all();
+    cv.wait(lk, [&] { return full < NR; });
+    wb = (wb + 1) % NR;
+    r = 0;
+}
 
-            // Меркурий
-            Mercury.gs = G * Sun.M / pow(norm((Mercury.x - Sun.x), (Mercury.y - Sun.y)), 2);
+// Фоновая запись: полные блоки по очереди, после close — и неполный последний
+void Recorder::writer() {
 
-            // Венера
-            Venus.gs = G * Sun.M / pow(norm((Venus.x - Sun.x), (Venus.y - Sun.y)), 2);
+    int rb = 0;
+    std::vector<double> cs((size_t)nc * K);
 
-            // Земля
-            Earth.gs = G * Sun.M / pow(norm((Earth.x - Sun.x), (Earth.y - Sun.y)), 2);
+    for (;;) {
+        std::unique_lock<std::mutex> lk(mx);
+        cv.wait(lk, [&] { return full > 0 || done; });
 
-            // Луна
-            Luna.gs = G * Sun.M / pow(norm((Luna.x - Sun.x), (Luna.y - Sun.y)), 2);
-            Luna.gp = G * Earth.M / pow(norm((Luna.x - Earth.x), (Luna.y - Earth.y)), 2);
+        if (full == 0) {
 
-            // Марс
-            Mars.gs = G * Sun.M / pow(norm((Mars.x - Sun.x), (Mars.y - Sun.y)), 2);
+            // Неполный блок после остановки
+            if (r > 0)
+                flush(wb, r, cs);
+            return;
+        }
+        lk.unlock();
 
-            // Юпитер
-            Jupiter.gs = G * Sun.M / pow(norm((Jupiter.x - Sun.x), (Jupiter.y - Sun.y)), 2);
+        flush(rb, K, cs);
+        rb = (rb + 1) % NR;
 
-            // Сатурн
-            Saturn.gs = G * Sun.M / pow(norm((Saturn.x - Sun.x), (Saturn.y - Sun.y)), 2);
+        lk.lock();
+        full--;
+        cv.notify_all();
+    }
+}
 
-            // Уран
-            Uran.gs = G * Sun.M / pow(norm((Uran.x - Sun.x), (Uran.y - Sun.y)), 2);
+// Запись k строк блока b: число строк, затем столбцы подряд
+void Recorder::flush(int b, int k, std::vector<double>& cs) {
 
-            // Нептун
-            Neptune.gs = G * Sun.M / pow(norm((Neptune.x - Sun.x), (Neptune.y - Sun.y)), 2);
+    const double* p = ring[b].data();
+    for (int i = 0; i < k; i++)
+        for (int j = 0; j < nc; j++)
+            cs[(size_t)j * k + i] = p[(size_t)i * nc + j];
 
+    uint64_t u = k;
+    fs.write((const char*)&u, sizeof u);
+    fs.write((const char*)cs.data(), (size_t)nc * k * sizeof(double));
+}
 
-            // Углы относительно Солнца //
+// Остаток строк в файл и остановка потока записи
+void Recorder::close() {
+    if (!th.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mx);
+        done = 1;
+    }
+    cv.notify_all();
+    th.join();
+    fs.close();
+}
 
-            // РН
-            if (Rocket.x >= Sun.x) {
-                Rocket.phis = acos(dot((Rocket.x - Sun.x), (Rocket.y - Sun.y), Z) / norm((Rocket.x - Sun.x), (Rocket.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Rocket.phis = -acos(dot((Rocket.x - Sun.x), (Rocket.y - Sun.y), Z) / norm((Rocket.x - Sun.x), (Rocket.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+Recorder::~Recorder() {
+    close();
+}
 
-            // Меркурий
-            if (Mercury.x >= Sun.x) {
-                Mercury.phis = acos(dot((Mercury.x - Sun.x), (Mercury.y - Sun.y), Z) / norm((Mercury.x - Sun.x), (Mercury.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Mercury.phis = -acos(dot((Mercury.x - Sun.x), (Mercury.y - Sun.y), Z) / norm((Mercury.x - Sun.x), (Mercury.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+// Разбор файла записи траектории: заголовок, имена столбцов и блоки по порядку;
+// тела — по столбцам xN, их скорости и массы идут следом
+bool Replay::open(const char* fn, int n) {
+
+    if (!mf.open(fn) || mf.len < 16 || memcmp(mf.base, recTag, sizeof recTag) != 0)
+        return 0;
+
+    uint32_t v, k;
+    memcpy(&v, mf.base + 8, sizeof v);
+    memcpy(&k, mf.base + 12, sizeof k);
+    nc = k;
+    if (v != recVer || nc < 1 || mf.len < 16 + (size_t)nc * 16)
+        return 0;
+
+    rec.assign(n, 0);
+    for (int c = 0; c < nc; c++) {
+        char s[17] = {};
+        memcpy(s, mf.base + 16 + (size_t)c * 16, 16);
+        int i;
+        if (s[0] == 'x' && sscanf(s + 1, "%d", &i) == 1 && i >= 0 && i < n && c + 4 < nc) {
+            bi.push_back(i);
+            bx.push_back(c);
+            rec[i] = 1;
+        }
+    }
 
-            // Венера
-            if (Venus.x >= Sun.x) {
-                Venus.phis = acos(dot((Venus.x - Sun.x), (Venus.y - Sun.y), Z) / norm((Venus.x - Sun.x), (Venus.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Venus.phis = -acos(dot((Venus.x - Sun.x), (Venus.y - Sun.y), Z) / norm((Venus.x - Sun.x), (Venus.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+    // Блоки: число строк и столбцы; отображение выровнено по странице, заголовок
+    // и счётчики строк кратны 8 байтам, поэтому числа читаются на месте
+    size_t o = 16 + (size_t)nc * 16;
+    while (o + 8 <= mf.len) {
+        const uint64_t r = *(const uint64_t*)(mf.base + o);
+        o += 8;
+        if (r == 0 || r > (mf.len - o) / ((size_t)nc * sizeof(double)))
+            return 0;
+        r0.push_back(nr);
+        rk.push_back(r);
+        cp.push_back((const double*)(mf.base + o));
+        nr += r;
+        o += (size_t)r * nc * sizeof(double);
+    }
 
-            // Земля
-            if (Earth.x >= Sun.x) {
-                Earth.phis = acos(dot((Earth.x - Sun.x), (Earth.y - Sun.y), Z) / norm((Earth.x - Sun.x), (Earth.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Earth.phis = -acos(dot((Earth.x - Sun.x), (Earth.y - Sun.y), Z) / norm((Earth.x - Sun.x), (Earth.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+    if (nr < 2 || o != mf.len)
+        return 0;
 
-            // Луна
-            if (Luna.x >= Sun.x) {
-                Luna.phis = acos(dot((Luna.x - Sun.x), (Luna.y - Sun.y), Z) / norm((Luna.x - Sun.x), (Luna.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Luna.phis = -acos(dot((Luna.x - Sun.x), (Luna.y - Sun.y), Z) / norm((Luna.x - Sun.x), (Luna.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+    t0 = val(0, 0);
+    t1 = val(0, nr - 1);
+    return 1;
+}
 
-            // Марс
-            if (Mars.x >= Sun.x) {
-                Mars.phis = acos(dot((Mars.x - Sun.x), (Mars.y - Sun.y), Z) / norm((Mars.x - Sun.x), (Mars.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Mars.phis = -acos(dot((Mars.x - Sun.x), (Mars.y - Sun.y), Z) / norm((Mars.x - Sun.x), (Mars.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+// Значение столбца c в строке r: блок ищется двоичным поиском по первым строкам
+double Replay::val(int c, long long r) const {
+    size_t b = std::upper_bound(r0.begin(), r0.end(), r) - r0.begin() - 1;
+    return cp[b][(size_t)c * rk[b] + (r - r0[b])];
+}
 
-            // Юпитер
-            if (Jupiter.x >= Sun.x) {
-                Jupiter.phis = acos(dot((Jupiter.x - Sun.x), (Jupiter.y - Sun.y), Z) / norm((Jupiter.x - Sun.x), (Jupiter.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Jupiter.phis = -acos(dot((Jupiter.x - Sun.x), (Jupiter.y - Sun.y), Z) / norm((Jupiter.x - Sun.x), (Jupiter.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+// Координаты, скорости и массы записанных тел в момент t: строки вокруг t
+// находятся двоичным поиском по столбцу времени
+void Replay::at(double t, Bodies& b) const {
+
+    long long lo = 0, hi = nr - 1;
+    while (hi - lo > 1) {
+        long long m = (lo + hi) / 2;
+        if (val(0, m) <= t)
+            lo = m;
+        else
+            hi = m;
+    }
 
-            // Сатурн
-            if (Saturn.x >= Sun.x) {
-                Saturn.phis = acos(dot((Saturn.x - Sun.x), (Saturn.y - Sun.y), Z) / norm((Saturn.x - Sun.x), (Saturn.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Saturn.phis = -acos(dot((Saturn.x - Sun.x), (Saturn.y - Sun.y), Z) / norm((Saturn.x - Sun.x), (Saturn.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+    const double ta = val(0, lo), h = val(0, hi) - ta;
+    const double s = h > 0 ? clamp((t - ta) / h, 0, 1) : 0, s2 = s * s, s3 = s2 * s;
+    const double h00 = 2 * s3 - 3 * s2 + 1, h10 = (s3 - 2 * s2 + s) * h, h01 = 3 * s2 - 2 * s3, h11 = (s3 - s2) * h;
+
+    for (size_t j = 0; j < bi.size(); j++) {
+        const int i = bi[j], c = bx[j];
+        double x0 = val(c, lo), y0 = val(c + 1, lo), vx0 = val(c + 2, lo), vy0 = val(c + 3, lo);
+        double x1 = val(c, hi), y1 = val(c + 1, hi), vx1 = val(c + 2, hi), vy1 = val(c + 3, hi);
+        b.x[i] = h00 * x0 + h10 * vx0 + h01 * x1 + h11 * vx1;
+        b.y[i] = h00 * y0 + h10 * vy0 + h01 * y1 + h11 * vy1;
+        b.Vx[i] = vx0 + (vx1 - vx0) * s;
+        b.Vy[i] = vy0 + (vy1 - vy0) * s;
+        b.M[i] = val(c + 4, lo) + (val(c + 4, hi) - val(c + 4, lo)) * s;
+    }
+}
 
-            // Уран
-            if (Uran.x >= Sun.x) {
-                Uran.phis = acos(dot((Uran.x - Sun.x), (Uran.y - Sun.y), Z) / norm((Uran.x - Sun.x), (Uran.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Uran.phis = -acos(dot((Uran.x - Sun.x), (Uran.y - Sun.y), Z) / norm((Uran.x - Sun.x), (Uran.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+// Заполнение таблицы атмосферы: температура — линейно между высотами таблицы Tvm,
+// давление — по барометрической формуле с ускорением свободного падения на высоте
+void Atmosphere::build(double GM, double Re) {
 
-            // Нептун
-            if (Neptune.x >= Sun.x) {
-                Neptune.phis = acos(dot((Neptune.x - Sun.x), (Neptune.y - Sun.y), Z) / norm((Neptune.x - Sun.x), (Neptune.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Neptune.phis = -acos(dot((Neptune.x - Sun.x), (Neptune.y - Sun.y), Z) / norm((Neptune.x - Sun.x), (Neptune.y - Sun.y)) / norm(Z[0], Z[1]));
-            }
+    P.clear();
+    rho.clear();
+    f.clear();
+    a.clear();
 
+    int k = 0;
 
-            // Углы относительно планеты //
+    for (double h = 0; h <= 100000; h += dh) {
 
-            // РН
-            if (Rocket.x >= Earth.x) {
-                Rocket.phip = acos(dot((Rocket.x - Earth.x), (Rocket.y - Earth.y), Z) / norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Rocket.phip = -acos(dot((Rocket.x - Earth.x), (Rocket.y - Earth.y), Z) / norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) / norm(Z[0], Z[1]));
-            }
+        // Слой таблицы, в котором лежит высота
+        while (k < 27 && h >= Tvm[0][k + 1])
+            k++;
 
-            // Луна
-            if (Luna.x >= Earth.x) {
-                Luna.phip = acos(dot((Luna.x - Earth.x), (Luna.y - Earth.y), Z) / norm((Luna.x - Earth.x), (Luna.y - Earth.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Luna.phip = -acos(dot((Luna.x - Earth.x), (Luna.y - Earth.y), Z) / norm((Luna.x - Earth.x), (Luna.y - Earth.y)) / norm(Z[0], Z[1]));
-            }
+        // Температура воздуха на данной высоте, К
+        double T = Tvm[1][k] + (Tvm[1][k + 1] - Tvm[1][k]) * (h - Tvm[0][k]) / (Tvm[0][k + 1] - Tvm[0][k]);
 
+        // Ускорение свободного падения на данной высоте, м/с2
+        double gp = GM / ((Re + h) * (Re + h));
 
-            // Углы относительно Луны //
+        // Давление и плотность воздуха на данной высоте
+        double p = Pvm * pow(e, (-Mv * gp * h / R / T));
+        double r = p * Mv / R / T;
 
-            // РН 
-            if (Rocket.x >= Luna.x) {
-                Rocket.phil = acos(dot((Rocket.x - Luna.x), (Rocket.y - Luna.y), Z) / norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) / norm(Z[0], Z[1]));
-            }
-            else {
-                Rocket.phil = -acos(dot((Rocket.x - Luna.x), (Rocket.y - Luna.y), Z) / norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) / norm(Z[0], Z[1]));
-            }
+        P.push_back(p);
+        rho.push_back(r);
+        f.push_back(r / rvm);
 
+        // Скорость звука при показателе адиабаты 1,4
+        a.push_back(sqrt(1.4 * R * T / Mv));
 
-           // Тяга двигателей //
+        if (r / rvm < 1e-16)
+            break;
+    }
+}
 
-            if (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R < 100000) {
+// Значения на высоте h линейной интерполяцией между узлами, выше таблицы — пустота
+void Atmosphere::at(double h, double& P, double& rho, double& f, double& a) const {
 
-                TVm = Tvm[1][0];
+    double q = h > 0 ? h / dh : 0;
+    int i = (int)q;
 
-                for (int i = 0; i < 29; i++) {
-                    if (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R >= Tvm[0][i]) {
+    if (i >= (int)this->f.size() - 1) {
+        P = 0;
+        rho = 0;
+        f = 0;
+        a = this->a.back();
+        return;
+    }
 
-                        // Температура воздуха на данной высоте, К
-                        TVm = Tvm[1][i];
+    q -= i;
+    P = this->P[i] + (this->P[i + 1] - this->P[i]) * q;
+    rho = this->rho[i] + (this->rho[i + 1] - this->rho[i]) * q;
+    f = this->f[i] + (this->f[i + 1] - this->f[i]) * q;
+    a = this->a[i] + (this->a[i + 1] - this->a[i]) * q;
+}
 
-                        // Давление воздуха на данной высоте, Па
-                        Pv = Pvm * pow(e, (-Mv * Rocket.gp * (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R) / R / TVm));
+// Отображение файла в память только для чтения: 1, если удалось и файл не пуст
+bool Mapped::open(const char* fn) {
+
+#ifdef _WIN32
+    fh = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(fh, &sz) || sz.QuadPart <= 0)
+        return 0;
+    len = (size_t)sz.QuadPart;
+
+    mh = CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mh)
+        return 0;
+
+    base = (const char*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    return base != nullptr;
+#else
+    int fd = ::open(fn, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size <= 0) {
+        ::close(fd);
+        return 0;
+    }
+    len = (size_t)sb.st_size;
+
+    void* p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return 0;
+    base = (const char*)p;
+    return 1;
+#endif
+}
 
-                        // Плотность воздуха на данной высоте, кг/м3
-                        rv = Pv * Mv / R / TVm;
+// Снятие отображения файла
+Mapped::~Mapped() {
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mh)
+        CloseHandle(mh);
+    if (fh != INVALID_HANDLE_VALUE)
+        CloseHandle(fh);
+#else
+    if (base)
+        munmap((void*)base, len);
+#endif
+}
 
-                        // Тяга двигателей на данной высоте, кН
-                        Ts = Tpp - (Tpp - Tmm) * rv / rvm;
+// Отображение файла кэша в память: 1, если формат и размер верны
+bool Ephemeris::open(const char* fn) {
 
-                        // Удельная тяга твигателей на данной высоте, м/с
-                        Is = Ipp - (Ipp - Imm) * rv / rvm;
+    if (!mf.open(fn) || mf.len < sizeof hd)
+        return 0;
 
-                        break;
-                    }
-                }
-            }
-            else {
-                Ts = Tpp;
-                Is = Ipp;
-            }
+    memcpy(&hd, mf.base, sizeof hd);
 
-            if (hg == 0) {
+    if (memcmp(hd.tag, ephemTag, sizeof hd.tag) != 0 || hd.ver != ephemVer || hd.nb == 0 || hd.ns < 2 || !(hd.h > 0))
+        return 0;
+    if (mf.len != sizeof hd + (size_t)hd.ns * hd.nb * 6 * sizeof(double))
+        return 0;
 
-                // Ускорение РН от двигателей, м/с2
-                ad = Ts / Rocket.M * 1000;
-            }
-            else {
-                ad = 0;
-                Ts = 0;
-            }
+    d = (const double*)(mf.base + sizeof hd);
+    return 1;
+}
 
+// Факт узлов, покрывающих время t
+bool Ephemeris::has(double t) const {
+    return d && t >= hd.t0 && t <= hd.t0 + (hd.ns - 1) * hd.h;
+}
 
-            // Полные ускорения //
+// Состояния и ускорения тел кэша в момент t: координаты по узловым координатам
+// и скоростям, скорости по узловым скоростям и ускорениям, ускорение — производная скорости
+void Ephemeris::at(double t, Bodies& b, bool st) const {
+
+    const double h = hd.h;
+    const int nb = hd.nb;
+    double u = (t - hd.t0) / h;
+    long long k = (long long)u;
+    if (k > hd.ns - 2)
+        k = hd.ns - 2;
+    if (k < 0)
+        k = 0;
+
+    // Базисные функции Эрмита и их производные по s
+    const double s = u - k, s2 = s * s, s3 = s2 * s;
+    const double h00 = 2 * s3 - 3 * s2 + 1, h10 = (s3 - 2 * s2 + s) * h, h01 = 3 * s2 - 2 * s3, h11 = (s3 - s2) * h;
+    const double d00 = (6 * s2 - 6 * s) / h, d10 = 3 * s2 - 4 * s + 1, d11 = 3 * s2 - 2 * s;
+
+    const double* p = d + k * nb * 6;
+    const double* q = p + nb * 6;
+
+    for (int i = 0; i < nb; i++, p += 6, q += 6) {
+        if (st) {
+            b.x[i] = h00 * p[0] + h10 * p[2] + h01 * q[0] + h11 * q[2];
+            b.y[i] = h00 * p[1] + h10 * p[3] + h01 * q[1] + h11 * q[3];
+            b.Vx[i] = h00 * p[2] + h10 * p[4] + h01 * q[2] + h11 * q[4];
+            b.Vy[i] = h00 * p[3] + h10 * p[5] + h01 * q[3] + h11 * q[5];
+        }
+        b.ax[i] = d00 * (p[2] - q[2]) + d10 * p[4] + d11 * q[4];
+        b.ay[i] = d00 * (p[3] - q[3]) + d10 * p[5] + d11 * q[5];
+    }
+}
 
-            // Меркурий
-            Mercury.ax = -Mercury.gs * sin(Mercury.phis);
-            Mercury.ay = -Mercury.gs * cos(Mercury.phis);
+// Коэффициент лобового сопротивления при числе Маха m: линейно между узлами
+double Stage::cd(double m) const {
 
-            // Венера
-            Venus.ax = -Venus.gs * sin(Venus.phis);
-            Venus.ay = -Venus.gs * cos(Venus.phis);
+    if (m <= Ma[0])
+        return Cd[0];
 
-            // Земля
-            Earth.ax = -Earth.gs * sin(Earth.phis);
-            Earth.ay = -Earth.gs * cos(Earth.phis);
+    for (int i = 1; i < 9; i++)
+        if (m < Ma[i])
+            return Cd[i - 1] + (Cd[i] - Cd[i - 1]) * (m - Ma[i - 1]) / (Ma[i] - Ma[i - 1]);
 
-            // Луна
-            Luna.ax = -Luna.gs * sin(Luna.phis) - Luna.gp * sin(Luna.phip);
-            Luna.ay = -Luna.gs * cos(Luna.phis) - Luna.gp * cos(Luna.phip);
+    return Cd[8];
+}
 
-            // Марс
-            Mars.ax = -Mars.gs * sin(Mars.phis);
-            Mars.ay = -Mars.gs * cos(Mars.phis);
+// Добавление тела в таблицу
+int Bodies::add(double M, double R, double x, double y, double Vx, double Vy, unsigned mk, Color C) {
+    this->M.push_back(M);
+    this->R.push_back(R);
+    this->x.push_back(x);
+    this->y.push_back(y);
+    this->Vx.push_back(Vx);
+    this->Vy.push_back(Vy);
+    ax.push_back(0);
+    ay.push_back(0);
+    this->mk.push_back(mk);
+    this->C.push_back(C);
+    return n++;
+}
 
-            // Юпитер
-            Jupiter.ax = -Jupiter.gs * sin(Jupiter.phis);
-            Jupiter.ay = -Jupiter.gs * cos(Jupiter.phis);
+// Ускорения тел по выбранной модели тяготения: всех или только тел из списка act
+void gravity(Bodies& b, int gm, double th, const std::vector<int>* act) {
+    switch (gm) {
+    case GRAV_PAIR:
+        gravityPair(b, act);
+        break;
+    case GRAV_TREE:
+        gravityTree(b, th, act);
+        break;
+    default:
+        gravityMask(b, act);
+        break;
+    }
+}
 
-            // Сатурн
-            Saturn.ax = -Saturn.gs * sin(Saturn.phis);
-            Saturn.ay = -Saturn.gs * cos(Saturn.phis);
+// Ускорения тел от притягивающих тел по маскам
+void gravityMask(Bodies& b, const std::vector<int>* act) {
+
+    const int n = b.n;
+    const double* __restrict x = b.x.data();
+    const double* __restrict y = b.y.data();
+    const unsigned* __restrict mk = b.mk.data();
+    double* __restrict ax = b.ax.data();
+    double* __restrict ay = b.ay.data();
+
+    // Только тела из списка: обход битов маски каждого тела
+    if (act) {
+        for (int i : *act) {
+            double axi = 0, ayi = 0;
+            for (int j = 0; j < n && j < 32 && mk[i] >> j; j++) {
+                if (!(mk[i] >> j & 1))
+                    continue;
+                double dx = x[i] - x[j];
+                double dy = y[i] - y[j];
+                double r2 = dx * dx + dy * dy;
+                double g = G * b.M[j] / (r2 * sqrt(r2));
+                axi -= g * dx;
+                ayi -= g * dy;
+            }
+            ax[i] = axi;
+            ay[i] = ayi;
+        }
+        return;
+    }
 
-            // Уран
-            Uran.ax = -Uran.gs * sin(Uran.phis);
-            Uran.ay = -Uran.gs * cos(Uran.phis);
+    // Объединение масок: тела, которые притягивают хотя бы одно тело
+    unsigned am = 0;
 
-            // Нептун
-            Neptune.ax = -Neptune.gs * sin(Neptune.phis);
-            Neptune.ay = -Neptune.gs * cos(Neptune.phis);
+    for (int i = 0; i < n; i++) {
+        ax[i] = 0;
+        ay[i] = 0;
+        am |= mk[i];
+    }
 
+    for (int j = 0; j < n && j < 32; j++) {
 
-            // РН
-            if (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R < 20000) {
-                Rocket.ax = (ad - Rocket.gp) * sin(Rocket.phip) - Rocket.gs * sin(Rocket.phis) - Rocket.gl * sin(Rocket.phil);
-                Rocket.ay = (ad - Rocket.gp) * cos(Rocket.phip) - Rocket.gs * cos(Rocket.phis) - Rocket.gl * cos(Rocket.phil);
-            }
-            else if (t < t1) {
+        if (!(am >> j & 1))
+            continue;
 
-                    alpha = pi / 2 * (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R) / 180000;
-                    alpha = Rocket.phip + clamp(alpha, 0, pi / 2);
+        const double GM = G * b.M[j], xj = x[j], yj = y[j];
 
-                    Rocket.ax = ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-                    Rocket.ay = ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
-            }
-            else if (t >= t1 && t < t2) {
+        // Внутренний цикл без ветвлений векторизуется компилятором:
+        // для тел вне маски w = 0, а к r2 добавляется 1, чтобы не делить на ноль
+        for (int i = 0; i < n; i++) {
+            double w = (double)(mk[i] >> j & 1);
+            double dx = x[i] - xj;
+            double dy = y[i] - yj;
+            double r2 = dx * dx + dy * dy + (1 - w);
+            double g = w * GM / (r2 * sqrt(r2));
+            ax[i] -= g * dx;
+            ay[i] -= g * dy;
+        }
+    }
+}
 
-                if (Rocket.y - Earth.y >= 0)
-                    alpha = acos((Rocket.Vy - Earth.Vy) / norm((Rocket.Vx - Earth.Vx), (Rocket.Vy - Earth.Vy)));
-                else
-                    alpha = -acos((Rocket.Vy - Earth.Vy) / norm((Rocket.Vx - Earth.Vx), (Rocket.Vy - Earth.Vy)));
+// Взаимное тяготение всех тел попарно, O(N^2) блоками по телам
+void gravityPair(Bodies& b, const std::vector<int>* act) {
+
+    const int n = b.n;
+
+    // Притягивающие тела (с ненулевой массой) в сжатом виде
+    thread_local std::vector<double> sx, sy, sm;
+    thread_local std::vector<int> si;
+    sx.clear();
+    sy.clear();
+    sm.clear();
+    si.clear();
+
+    for (int j = 0; j < n; j++) {
+        if (b.M[j] > 0) {
+            sx.push_back(b.x[j]);
+            sy.push_back(b.y[j]);
+            sm.push_back(G * b.M[j]);
+            si.push_back(j);
+        }
+    }
 
-                Rocket.ax = ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-                Rocket.ay = ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
+    const int ns = (int)si.size();
+    const double* __restrict x = b.x.data();
+    const double* __restrict y = b.y.data();
+    double* __restrict ax = b.ax.data();
+    double* __restrict ay = b.ay.data();
+
+    // Только тела из списка
+    if (act) {
+        for (int i : *act) {
+            double axi = 0, ayi = 0;
+            for (int k = 0; k < ns; k++) {
+                if (si[k] == i)
+                    continue;
+                double dx = x[i] - sx[k];
+                double dy = y[i] - sy[k];
+                double r2 = dx * dx + dy * dy;
+                double g = sm[k] / (r2 * sqrt(r2));
+                axi -= g * dx;
+                ayi -= g * dy;
             }
-            else if (t >= t2 && t < t3) {
+            ax[i] = axi;
+            ay[i] = ayi;
+        }
+        return;
+    }
 
-                if (Rocket.y - Luna.y >= 0)
-                    alpha = pi + acos((Rocket.Vy - Luna.Vy) / norm((Rocket.Vx - Luna.Vx), (Rocket.Vy - Luna.Vy)));
-                else
-                    alpha = pi - acos((Rocket.Vy - Luna.Vy) / norm((Rocket.Vx - Luna.Vx), (Rocket.Vy - Luna.Vy)));
+    for (int i = 0; i < n; i++) {
+        ax[i] = 0;
+        ay[i] = 0;
+    }
 
-                Rocket.ax = ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-                Rocket.ay = ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
-            }
-            else if (t >= t3 && !st) {
+    // Блок притягиваемых тел помещается в кэш L1 вместе с ускорениями
+    const int bs = 256;
 
-                alpha = -pi / 2 + Rocket.phil;
+    for (int i0 = 0; i0 < n; i0 += bs) {
 
-                if (t < t4) {
-                    Rocket.ax = ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-                    Rocket.ay = ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
-                }
-                else {
-                    Rocket.ax = 5 * ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-                    Rocket.ay = 5 * ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
+        const int i1 = i0 + bs < n ? i0 + bs : n;
+
+        for (int k = 0; k < ns; k++) {
+
+            const double xj = sx[k], yj = sy[k], GM = sm[k];
+            const int j = si[k];
+
+            // Тело само на себя не действует: тело j делит блок на два отрезка,
+            // и внутренний цикл по отрезку без ветвлений векторизуется компилятором
+            const int ja = j < i0 ? i0 : j > i1 ? i1 : j;
+            const int jb = j >= i0 && j < i1 ? j + 1 : ja;
+            const int lo[2] = { i0, jb }, hi[2] = { ja, i1 };
+
+            for (int p = 0; p < 2; p++) {
+                for (int i = lo[p]; i < hi[p]; i++) {
+                    double dx = x[i] - xj;
+                    double dy = y[i] - yj;
+                    double r2 = dx * dx + dy * dy;
+                    double g = GM / (r2 * sqrt(r2));
+                    ax[i] -= g * dx;
+                    ay[i] -= g * dy;
                 }
             }
+        }
+    }
+}
 
-            else {
+// Узел квадродерева Барнса — Хата //
+struct Node {
 
-            alpha = Rocket.phil;
+    // Центр квадрата узла и половина его стороны, м
+    double cx, cy, hs;
 
-            Rocket.ax = ad * sin(alpha) - Rocket.gs * sin(Rocket.phis) - Rocket.gp * sin(Rocket.phip) - Rocket.gl * sin(Rocket.phil);
-            Rocket.ay = ad * cos(alpha) - Rocket.gs * cos(Rocket.phis) - Rocket.gp * cos(Rocket.phip) - Rocket.gl * cos(Rocket.phil);
-            }
+    // Центр масс узла, м
+    double x, y;
 
-            // Скорости //
+    // Гравитационный параметр узла, м3/с2
+    double GM;
 
-            // РН
-            Rocket.Vx += Rocket.ax * dt;
-            Rocket.Vy += Rocket.ay * dt;
+    // Индекс первого из четырёх потомков, -1 у листа
+    int ch;
 
-            // Меркурий
-            Mercury.Vx += Mercury.ax * dt;
-            Mercury.Vy += Mercury.ay * dt;
+    // Индекс тела в листе, -1 у пустого листа
+    int bi;
+};
 
-            // Венера
-            Venus.Vx += Venus.ax * dt;
-            Venus.Vy += Venus.ay * dt;
+// Постоянные потоки для деления обхода дерева между ядрами: создаются один раз
+// при первом большом вычислении сил и ждут работы между шагами //
+struct Crew {
 
-            // Земля
-            Earth.Vx += Earth.ax * dt;
-            Earth.Vy += Earth.ay * dt;
+    std::vector<std::thread> th;
 
-            // Луна
-            Luna.Vx += Luna.ax * dt;
-            Luna.Vy += Luna.ay * dt;
+    // Защита задания и очередь вызывающих потоков
+    std::mutex mx, busy;
+    std::condition_variable cv, dn;
 
-            // Марс
-            Mars.Vx += Mars.ax * dt;
-            Mars.Vy += Mars.ay * dt;
+    // Задание, его номер и число потоков, ещё не закончивших его
+    const std::function<void(int)>* job = nullptr;
+    long long gen = 0;
+    int left = 0;
+    bool stop = 0;
 
-            // Юпитер
-            Jupiter.Vx += Jupiter.ax * dt;
-            Jupiter.Vy += Jupiter.ay * dt;
+    // Создание n потоков помимо вызывающего
+    explicit Crew(int n);
+    ~Crew();
 
-            // Сатурн
-            Saturn.Vx += Saturn.ax * dt;
-            Saturn.Vy += Saturn.ay * dt;
+    // Число частей задания: потоки и вызывающий
+    int size() const { return (int)th.size() + 1; }
 
-            // Уран
-            Uran.Vx += Uran.ax * dt;
-            Uran.Vy += Uran.ay * dt;
+    // Выполнение f(p) для p от 0 до size() - 1, часть 0 — в вызывающем потоке
+    void run(const std::function<void(int)>& f);
 
-            // Нептун
-            Neptune.Vx += Neptune.ax * dt;
-            Neptune.Vy += Neptune.ay * dt;
+    // Ожидание и выполнение частей p заданий
+    void loop(int p);
+};
 
+// Потоки для обхода дерева: по одному на ядро, кроме вызывающего
+Crew& crew() {
+    static Crew c(std::max(1, (int)std::thread::hardware_concurrency()) - 1);
+    return c;
+}
 
-            // Координаты //
+Crew::Crew(int n) {
+    for (int p = 1; p <= n; p++)
+        th.emplace_back(&Crew::loop, this, p);
+}
 
-            // РН
-            Rocket.x += Rocket.Vx * dt;
-            Rocket.y += Rocket.Vy * dt;
+Crew::~Crew() {
+    {
+        std::lock_guard<std::mutex> lk(mx);
+        stop = 1;
+    }
+    cv.notify_all();
+    for (std::thread& t : th)
+        t.join();
+}
 
-            // Меркурий
-            Mercury.x += Mercury.Vx * dt;
-            Mercury.y += Mercury.Vy * dt;
+void Crew::run(const std::function<void(int)>& f) {
 
-            // Венера
-            Venus.x += Venus.Vx * dt;
-            Venus.y += Venus.Vy * dt;
+    std::lock_guard<std::mutex> bl(busy);
+    {
+        std::lock_guard<std::mutex> lk(mx);
+        job = &f;
+        left = (int)th.size();
+        gen++;
+    }
+    cv.notify_all();
 
-            // Земля
-            Earth.x += Earth.Vx * dt;
-            Earth.y += Earth.Vy * dt;
+    f(0);
 
-            // Луна
-            Luna.x += Luna.Vx * dt;
-            Luna.y += Luna.Vy * dt;
+    std::unique_lock<std::mutex> lk(mx);
+    dn.wait(lk, [&] { return left == 0; });
+}
 
-            // Марс
-            Mars.x += Mars.Vx * dt;
-            Mars.y += Mars.Vy * dt;
+void Crew::loop(int p) {
 
-            // Юпитер
-            Jupiter.x += Jupiter.Vx * dt;
-            Jupiter.y += Jupiter.Vy * dt;
+    long long g = 0;
 
-            // Сатурн
-            Saturn.x += Saturn.Vx * dt;
-            Saturn.y += Saturn.Vy * dt;
+    while (true) {
+        std::unique_lock<std::mutex> lk(mx);
+        cv.wait(lk, [&] { return stop || gen != g; });
+        if (stop)
+            return;
+        g = gen;
+        const std::function<void(int)>* f = job;
+        lk.unlock();
 
-            // Уран
-            Uran.x += Uran.Vx * dt;
-            Uran.y += Uran.Vy * dt;
+        (*f)(p);
 
-            // Нептун
-            Neptune.x += Neptune.Vx * dt;
-            Neptune.y += Neptune.Vy * dt;
+        lk.lock();
+        if (--left == 0)
+            dn.notify_one();
+    }
+}
 
+// Тяготение по дереву Барнса — Хата, O(N log N)
+void gravityTree(Bodies& b, double th, const std::vector<int>* act) {
 
-            // Массовый расход топлива, кг/с
-            Rocket.M -= Ts / Is * 1000 * dt;
-            Mtt -= Ts / Is * 1000 * dt;
+    const int n = b.n;
 
+    // Наибольшая глубина дерева: совпадающие тела остаются в одном листе
+    const int dmax = 60;
 
-            // Сброс ступени, если кончилось топливо
-            if (Mtt <= 0) {
-                switch (s) {
-                case 0:
-                    Mtt = Zwei.Mt;
-                    Tpp = Zwei.Tp;
-                    Tmm = Zwei.Tm;
-                    Ipp = Zwei.Ip;
-                    Imm = Zwei.Im;
-                    Rocket.M = Zwei.M + Drei.M + Rb.M + A.M;
-                    break;
-                case 1:
-                    Mtt = Drei.Mt;
-                    Tpp = Drei.Tp;
-                    Tmm = Drei.Tm;
-                    Ipp = Drei.Ip;
-                    Imm = Drei.Im;
-                    Rocket.M = Drei.M + Rb.M + A.M;
-                    break;
-                case 2:
-                    Mtt = Rb.Mt;
-                    Tpp = Rb.Tp;
-                    Tmm = Rb.Tp;
-                    Ipp = Rb.Ip;
-                    Imm = Rb.Ip;
-                    Rocket.M = Rb.M + A.M;
-                    break;
-                case 3:
-                    Mtt = A.Mt;
-                    Tpp = A.Tm;
-                    Tmm = A.Tm;
-                    Ipp = A.Ip;
-                    Imm = A.Ip;
-                    Rocket.M = A.M;
-                    break;
-                }
-                s++;
-            }
+    thread_local std::vector<Node> T;
+    T.clear();
 
-            // Получение нужной скорости на орбите Земли
-            if (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)) - Earth.R >= 180000 && hg == 0 && t <= 3000) {
+    // Квадрат, охватывающий все тела с массой
+    double x0 = 1e300, y0 = 1e300, x1 = -1e300, y1 = -1e300;
 
-                hg = 1;
+    for (int i = 0; i < n; i++) {
+        if (b.M[i] > 0) {
+            x0 = fmin(x0, b.x[i]);
+            y0 = fmin(y0, b.y[i]);
+            x1 = fmax(x1, b.x[i]);
+            y1 = fmax(y1, b.y[i]);
+        }
+    }
 
-                Rocket.Vy = Earth.Vy - 7800.650602 * sin(Rocket.phip);
-                Rocket.Vx = Earth.Vx + 7800.650602 * cos(Rocket.phip);
-            }
+    if (act) {
+        for (int i : *act) {
+            b.ax[i] = 0;
+            b.ay[i] = 0;
+        }
+    }
+    else {
+        for (int i = 0; i < n; i++) {
+            b.ax[i] = 0;
+            b.ay[i] = 0;
+        }
+    }
 
-            T++;
-            
-            // Расчёт первого импульса для полёта к Луне
-            if (t == t1) {
+    if (x0 > x1)
+        return;
 
-                hg = 0;
-                Vg1 = norm((Rocket.Vx - Earth.Vx), (Rocket.Vy - Earth.Vy)) * (pow((2 * ((norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) + Luna.R + pow(10, 5)) / (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)))) / (((norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) + Luna.R + pow(10, 5)) / (norm((Rocket.x - Earth.x), (Rocket.y - Earth.y)))) + 1)), 0.5) - 1);
-            }
+    T.push_back({ (x0 + x1) / 2, (y0 + y1) / 2, fmax(x1 - x0, y1 - y0) / 2 * 1.0001 + 1, 0, 0, 0, -1, -1 });
 
-            // Реализация первого импульса для полёта к Луне
-            if (t >= t1 && t < t2) {
-                dV += ad * dt;
-                if (dV >= Vg1 * 1.015) {
-                    hg = 1;
-                    dV = 0;
-                }
-            }
+    // Построение дерева вставкой тел по одному
+    for (int i = 0; i < n; i++) {
 
-            // Расчёт второго импульса для выхода на орбиту Луны 100 км
-            if (t == t2) {
-                hg = 0;
-                Vg2 = abs(pow((G * Luna.M / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)))), 0.5) * (pow((2 * ((Luna.R + 100000) / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)))) / ((Luna.R + 100000) / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y))) + 1)), 0.5) - 1));
-                Vg2 += abs(norm((Rocket.Vx - Luna.Vx), (Rocket.Vy - Luna.Vy)) - pow((G * Luna.M / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)))), 0.5));
-            }
+        if (b.M[i] <= 0)
+            continue;
 
-            // Реализация второго импульса для выхода на орбиту Луны 100 км
-            if (t >= t2 && t < 345500) {
-                dV += ad * dt;
-                if (dV >= Vg2) {
-                    hg = 1;
-                    dV = 0;
-                }
-            }
-            
-            // Выход аппарата на орбиту Луны 100 км
-            if (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) - Luna.R <= 100000 && t <= 346000) {
-                Rocket.Vy = Luna.Vy - 1607.80548 * sin(Rocket.phil);
-                Rocket.Vx = Luna.Vx + 1607.80548 * cos(Rocket.phil);
-            }
-            
-            // Расчёт третьего импульса для снижения низшей точки орбиты до 18 км
-            if (t == t3) {
-                hg = 0;
-                Vg3 = abs(norm((Rocket.Vx - Luna.Vx), (Rocket.Vy - Luna.Vy)) * (pow((2 * ((Luna.R + 18000) / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)))) / ((Luna.R + 18000) / (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y))) + 1)), 0.5) - 1));
+        const double GM = G * b.M[i];
+        int k = 0;
+
+        for (int d = 0; ; d++) {
+
+            // Пустой лист принимает тело
+            if (T[k].ch < 0 && T[k].bi < 0) {
+                T[k].bi = i;
+                T[k].x = b.x[i];
+                T[k].y = b.y[i];
+                T[k].GM = GM;
+                break;
             }
 
-            // Реализация третьего импульса для снижения низшей точки орбиты до 18 км
-            if (t >= t3 && t < 349700) {
-                dV += ad * dt;
-                if (dV >= Vg3) {
-                    hg = 1;
-                    dV = 0;
+            // Занятый лист делится на четыре, прежнее тело уходит в потомка
+            if (T[k].ch < 0) {
+
+                if (d >= dmax) {
+                    T[k].x = (T[k].x * T[k].GM + b.x[i] * GM) / (T[k].GM + GM);
+                    T[k].y = (T[k].y * T[k].GM + b.y[i] * GM) / (T[k].GM + GM);
+                    T[k].GM += GM;
+                    break;
                 }
+
+                const int c = (int)T.size();
+                const double q = T[k].hs / 2;
+
+                for (int j = 0; j < 4; j++)
+                    T.push_back({ T[k].cx + (j & 1 ? q : -q), T[k].cy + (j & 2 ? q : -q), q, 0, 0, 0, -1, -1 });
+
+                const int o = T[k].bi;
+                const int jo = (b.x[o] >= T[k].cx) + 2 * (b.y[o] >= T[k].cy);
+                T[c + jo].bi = o;
+                T[c + jo].x = T[k].x;
+                T[c + jo].y = T[k].y;
+                T[c + jo].GM = T[k].GM;
+
+                T[k].ch = c;
+                T[k].bi = -1;
             }
- 
-            if (t >= t4) {
 
-                if (t == t4) {
-                    hg = 0;
-                }
-                if (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) - Luna.R > 6100) {
-                    if ((Rocket.Vx - Luna.Vx) * cos(Rocket.phil) + (Rocket.Vy - Luna.Vy) * sin(Rocket.phil) <= 1) {
-                        st = 1;
-                        hg = 1;
-                    }
+            // Центр масс узла с учётом нового тела
+            T[k].x = (T[k].x * T[k].GM + b.x[i] * GM) / (T[k].GM + GM);
+            T[k].y = (T[k].y * T[k].GM + b.y[i] * GM) / (T[k].GM + GM);
+            T[k].GM += GM;
+
+            k = T[k].ch + (b.x[i] >= T[k].cx) + 2 * (b.y[i] >= T[k].cy);
+        }
+    }
+
+    // Порядок обхода тел: сначала тела в порядке листьев дерева, соседние тела
+    // проходят почти одинаковые пути и узлы остаются в кэше, затем остальные.
+    // Для списка act обходятся только его тела
+    thread_local std::vector<int> ord;
+    thread_local std::vector<char> in;
+    ord.clear();
+    in.assign(act ? 0 : n, 0);
+    int st[4 * 64];
+    int ns = 0;
+    if (act)
+        ord = *act;
+    else
+        st[ns++] = 0;
+
+    while (ns > 0) {
+        const Node& nd = T[st[--ns]];
+        if (nd.ch >= 0) {
+            for (int j = 3; j >= 0; j--)
+                st[ns++] = nd.ch + j;
+        }
+        else if (nd.bi >= 0) {
+            ord.push_back(nd.bi);
+            in[nd.bi] = 1;
+        }
+    }
+
+    // Тела без массы и тела, слитые в лист на предельной глубине
+    for (int i = 0; i < (int)in.size(); i++)
+        if (!in[i])
+            ord.push_back(i);
+
+    // Обход дерева для тел ord[a] .. ord[e - 1]; потоки обхода берут дерево и порядок
+    // по ссылкам — лямбда не захватывает thread_local, и в другом потоке T и ord пусты
+    const double th2 = th * th;
+    const std::vector<Node>& nodes = T;
+    const std::vector<int>& order = ord;
+
+    auto walk = [&](int a, int e) {
+
+        int st[4 * 64];
+
+        for (int o = a; o < e; o++) {
+
+            const int i = order[o];
+            const double xi = b.x[i], yi = b.y[i];
+            double axi = 0, ayi = 0;
+            int ns = 0;
+            st[ns++] = 0;
+
+            while (ns > 0) {
+
+                const Node& nd = nodes[st[--ns]];
+
+                if (nd.GM == 0 || nd.bi == i)
+                    continue;
+
+                double dx = xi - nd.x;
+                double dy = yi - nd.y;
+                double r2 = dx * dx + dy * dy;
+
+                // Лист или далёкий узел действует как точечная масса
+                if (nd.ch < 0 || 4 * nd.hs * nd.hs < th2 * r2) {
+                    double g = nd.GM / (r2 * sqrt(r2));
+                    axi -= g * dx;
+                    ayi -= g * dy;
                 }
-                
-                if (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) - Luna.R <= 6100) {
-                    if (abs((Rocket.Vx - Luna.Vx) * sin(Rocket.phil) + (Rocket.Vy - Luna.Vy) * cos(Rocket.phil)) >= 2)
-                        hg = 0;
-                    else
-                        hg = 1;
+                else {
+                    for (int j = 0; j < 4; j++)
+                        st[ns++] = nd.ch + j;
                 }
             }
 
-            if (norm((Rocket.x - Luna.x), (Rocket.y - Luna.y)) - Luna.R <= 0) {
-                Tv = 0;
-                std::cout << t - t4 << std::endl;
-            }
+            b.ax[i] = axi;
+            b.ay[i] = ayi;
+        }
+    };
 
-            // Отрисовка //
-
-            if (T == 1) {
-
-                // Меркурий
-                //CircleShape Mer(5.f);
-                CircleShape Mer(Mercury.R * k);
-                Mer.setPosition(width / 2 + (Mercury.x - Sun.x - X - Mercury.R) * k + dMx, height / 2 + (Mercury.y - Sun.y - Y - Mercury.R) * k + dMy);
-                //Mer.setPosition(width / 2 + (Mercury.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Mercury.y - Sun.y - Y) * k - 2.5f + dMy);
-                Mer.setFillColor(Color(120, 120, 120));
-                window.draw(Mer);
-
-                // Венера
-                //CircleShape Ven(5.f);
-                CircleShape Ven(Venus.R * k);
-                Ven.setPosition(width / 2 + (Venus.x - Sun.x - X - Venus.R) * k + dMx, height / 2 + (Venus.y - Sun.y - Y - Venus.R) * k - 2.5f + dMy);
-                //Ven.setPosition(width / 2 + (Venus.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Venus.y - Sun.y - Y) * k - 2.5f + dMy);
-                Ven.setFillColor(Color(255, 219, 139));
-                window.draw(Ven);
-
-                // Земля
-                //CircleShape Ear(5.f);
-                CircleShape Ear(Earth.R * k);
-                Ear.setPosition(width / 2 + (Earth.x - Sun.x - X - Earth.R) * k + dMx, height / 2 + (Earth.y - Sun.y - Y - Earth.R) * k + dMy);
-                //Ear.setPosition(width / 2 + (Earth.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Earth.y - Sun.y - Y) * k - 2.5f + dMy);
-                Ear.setFillColor(Color(0, 128, 255));
-                window.draw(Ear);
-
-                // Луна
-                //CircleShape Lun(5.f);
-                CircleShape Lun(Luna.R * k);
-                Lun.setPosition(width / 2 + (Luna.x - Sun.x - X - Luna.R) * k + dMx, height / 2 + (Luna.y - Sun.y - Y - Luna.R) * k + dMy);
-                //Lun.setPosition(width / 2 + (Luna.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Luna.y - Sun.y - Y) * k - 2.5f + dMy);
-                //Lun.setFillColor(Color::White);
-                Lun.setFillColor(Color::Black);
-                window.draw(Lun);
-
-                // Марс
-                //CircleShape Mar(5.f);
-                CircleShape Mar(Mars.R * k);
-                Mar.setPosition(width / 2 + (Mars.x - Sun.x - X - Mars.R) * k + dMx, height / 2 + (Mars.y - Sun.y - Y - Mars.R) * k + dMy);
-                //Mar.setPosition(width / 2 + (Mars.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Mars.y - Sun.y - Y) * k - 2.5f + dMy);
-                Mar.setFillColor(Color::Red);
-                window.draw(Mar);
-
-                // Юпитер
-                //CircleShape Jup(5.f);
-                CircleShape Jup(Jupiter.R * k);
-                Jup.setPosition(width / 2 + (Jupiter.x - Sun.x - X - Jupiter.R) * k + dMx, height / 2 + (Jupiter.y - Sun.y - Y - Jupiter.R) * k + dMy);
-                //Jup.setPosition(width / 2 + (Jupiter.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Jupiter.y - Sun.y - Y) * k - 2.5f + dMy);
-                Jup.setFillColor(Color(245, 245, 220));
-                window.draw(Jup);
-
-                // Сатурн
-                //CircleShape Sat(5.f);
-                CircleShape Sat(Saturn.R * k);
-                Sat.setPosition(width / 2 + (Saturn.x - Sun.x - X - Saturn.R) * k + dMx, height / 2 + (Saturn.y - Sun.y - Y - Saturn.R) * k + dMy);
-                //Sat.setPosition(width / 2 + (Saturn.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Saturn.y - Sun.y - Y) * k - 2.5f + dMy);
-                Sat.setFillColor(Color(166, 166, 0));
-                window.draw(Sat);
-
-                // Уран
-                //CircleShape Ur(5.f);
-                CircleShape Ur(Uran.R * k);
-                Ur.setPosition(width / 2 + (Uran.x - Sun.x - X - Uran.R) * k + dMx, height / 2 + (Uran.y - Sun.y - Y - Uran.R) * k + dMy);
-                //Ur.setPosition(width / 2 + (Uran.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Uran.y - Sun.y - Y) * k - 2.5f + dMy);
-                Ur.setFillColor(Color(0, 128, 128));
-                window.draw(Ur);
-
-                // Нептун
-                //CircleShape Nep(5.f);
-                CircleShape Nep(Neptune.R * k);
-                Nep.setPosition(width / 2 + (Neptune.x - Sun.x - X - Neptune.R) * k + dMx, height / 2 + (Neptune.y - Sun.y - Y - Neptune.R) * k + dMy);
-                //Nep.setPosition(width / 2 + (Neptune.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Neptune.y - Sun.y - Y) * k - 2.5f + dMy);
-                Nep.setFillColor(Color(70, 130, 180));
-                window.draw(Nep);
-
-                // РН
-                //RectangleShape Roc(Vector2f(3 * pow(10, 5) * k, pow(10, 6) * k));
-                CircleShape Roc(5.f);
-                //Roc.setPosition(width / 2 + (Rocket.x - Sun.x - 1.5 * pow(10, 5) / 2 - X) * k + dMx, height / 2 + (Rocket.y - Sun.y - Y) * k + dMy);
-                Roc.setPosition(width / 2 + (Rocket.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Rocket.y - Sun.y - Y) * k - 2.5f + dMy);
-                Roc.setFillColor(Color::Green);
-                //Roc.setRotation(-alpha * 180 / pi);
-                window.draw(Roc);
+    // Большие системы делятся между постоянными потоками; в параллельных миссиях
+    // ядра уже заняты, и обход идёт в своём потоке
+    const int no = (int)ord.size();
+    const int np = no >= 4096 && !solo ? crew().size() : 1;
 
-            }
+    if (np <= 1) {
+        walk(0, no);
+        return;
+    }
+
+    const std::function<void(int)> part = [&](int p) {
+        walk((int)((long long)no * p / np), (int)((long long)no * (p + 1) / np));
+    };
+    crew().run(part);
+}
+
+// Перенос по Кеплеру в универсальных переменных: положение и скорость относительно
+// центра с гравитационным параметром mu через время h; 0, если итерации не сошлись
+bool kepler(double mu, double& x, double& y, double& vx, double& vy, double h) {
+
+    // Функции Штумпфа C(z) и S(z), у нуля — ряды
+    auto C = [](double z) {
+        if (z > 1e-6)
+            return (1 - cos(sqrt(z))) / z;
+        if (z < -1e-6)
+            return (cosh(sqrt(-z)) - 1) / -z;
+        return 1.0 / 2 - z / 24 + z * z / 720;
+    };
+    auto S = [](double z) {
+        if (z > 1e-6) {
+            double s = sqrt(z);
+            return (s - sin(s)) / (s * s * s);
         }
+        if (z < -1e-6) {
+            double s = sqrt(-z);
+            return (sinh(s) - s) / (s * s * s);
+        }
+        return 1.0 / 6 - z / 120 + z * z / 5040;
+    };
+
+    const double r0 = norm(x, y), sm = sqrt(mu);
+    const double vr = (x * vx + y * vy) / r0;
+
+    // Величина, обратная большой полуоси, 1/м
+    const double al = 2 / r0 - (vx * vx + vy * vy) / mu;
+
+    // Универсальная аномалия методом Ньютона
+    double X = sm * fabs(al) * h;
+    bool ok = 0;
+
+    for (int it = 0; it < 50; it++) {
+        double z = al * X * X, c = C(z), s = S(z);
+        double F = r0 * vr / sm * X * X * c + (1 - al * r0) * X * X * X * s + r0 * X - sm * h;
+        double dF = r0 * vr / sm * X * (1 - z * s) + (1 - al * r0) * X * X * c + r0;
+        double dX = F / dF;
+        X -= dX;
+        if (fabs(dX) <= 1e-12 * (1 + fabs(X))) {
+            ok = 1;
+            break;
+        }
+    }
 
-        if (T == 0) {
-            
-            // Меркурий
-            //CircleShape Mer(5.f);
-            CircleShape Mer(Mercury.R* k);
-            Mer.setPosition(width / 2 + (Mercury.x - Sun.x - X - Mercury.R) * k + dMx, height / 2 + (Mercury.y - Sun.y - Y - Mercury.R) * k + dMy);
-            //Mer.setPosition(width / 2 + (Mercury.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Mercury.y - Sun.y - Y) * k - 2.5f + dMy);
-            Mer.setFillColor(Color(120, 120, 120));
-            window.draw(Mer);
-
-            // Венера
-            //CircleShape Ven(5.f);
-            CircleShape Ven(Venus.R* k);
-            Ven.setPosition(width / 2 + (Venus.x - Sun.x - X - Venus.R) * k + dMx, height / 2 + (Venus.y - Sun.y - Y - Venus.R) * k - 2.5f + dMy);
-            //Ven.setPosition(width / 2 + (Venus.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Venus.y - Sun.y - Y) * k - 2.5f + dMy);
-            Ven.setFillColor(Color(255, 219, 139));
-            window.draw(Ven);
-
-            // Земля
-            //CircleShape Ear(5.f);
-            CircleShape Ear(Earth.R* k);
-            Ear.setPosition(width / 2 + (Earth.x - Sun.x - X - Earth.R) * k + dMx, height / 2 + (Earth.y - Sun.y - Y - Earth.R) * k + dMy);
-            //Ear.setPosition(width / 2 + (Earth.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Earth.y - Sun.y - Y) * k - 2.5f + dMy);
-            Ear.setFillColor(Color(0, 128, 255));
-            window.draw(Ear);
-
-            // Луна
-            //CircleShape Lun(5.f);
-            CircleShape Lun(Luna.R* k);
-            Lun.setPosition(width / 2 + (Luna.x - Sun.x - X - Luna.R) * k + dMx, height / 2 + (Luna.y - Sun.y - Y - Luna.R) * k + dMy);
-            //Lun.setPosition(width / 2 + (Luna.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Luna.y - Sun.y - Y) * k - 2.5f + dMy);
-            //Lun.setFillColor(Color::White);
-            Lun.setFillColor(Color::Black);
-            window.draw(Lun);
-
-            // Марс
-            //CircleShape Mar(5.f);
-            CircleShape Mar(Mars.R* k);
-            Mar.setPosition(width / 2 + (Mars.x - Sun.x - X - Mars.R) * k + dMx, height / 2 + (Mars.y - Sun.y - Y - Mars.R) * k + dMy);
-            //Mar.setPosition(width / 2 + (Mars.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Mars.y - Sun.y - Y) * k - 2.5f + dMy);
-            Mar.setFillColor(Color::Red);
-            window.draw(Mar);
-
-            // Юпитер
-            //CircleShape Jup(5.f);
-            CircleShape Jup(Jupiter.R* k);
-            Jup.setPosition(width / 2 + (Jupiter.x - Sun.x - X - Jupiter.R) * k + dMx, height / 2 + (Jupiter.y - Sun.y - Y - Jupiter.R) * k + dMy);
-            //Jup.setPosition(width / 2 + (Jupiter.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Jupiter.y - Sun.y - Y) * k - 2.5f + dMy);
-            Jup.setFillColor(Color(245, 245, 220));
-            window.draw(Jup);
-
-            // Сатурн
-            //CircleShape Sat(5.f);
-            CircleShape Sat(Saturn.R* k);
-            Sat.setPosition(width / 2 + (Saturn.x - Sun.x - X - Saturn.R) * k + dMx, height / 2 + (Saturn.y - Sun.y - Y - Saturn.R) * k + dMy);
-            //Sat.setPosition(width / 2 + (Saturn.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Saturn.y - Sun.y - Y) * k - 2.5f + dMy);
-            Sat.setFillColor(Color(166, 166, 0));
-            window.draw(Sat);
-
-            // Уран
-            //CircleShape Ur(5.f);
-            CircleShape Ur(Uran.R* k);
-            Ur.setPosition(width / 2 + (Uran.x - Sun.x - X - Uran.R) * k + dMx, height / 2 + (Uran.y - Sun.y - Y - Uran.R) * k + dMy);
-            //Ur.setPosition(width / 2 + (Uran.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Uran.y - Sun.y - Y) * k - 2.5f + dMy);
-            Ur.setFillColor(Color(0, 128, 128));
-            window.draw(Ur);
-
-            // Нептун
-            //CircleShape Nep(5.f);
-            CircleShape Nep(Neptune.R* k);
-            Nep.setPosition(width / 2 + (Neptune.x - Sun.x - X - Neptune.R) * k + dMx, height / 2 + (Neptune.y - Sun.y - Y - Neptune.R) * k + dMy);
-            //Nep.setPosition(width / 2 + (Neptune.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Neptune.y - Sun.y - Y) * k - 2.5f + dMy);
-            Nep.setFillColor(Color(70, 130, 180));
-            window.draw(Nep);
-
-            // РН
-            //RectangleShape Roc(Vector2f(3 * pow(10, 5) * k, pow(10, 6) * k));
-            CircleShape Roc(5.f);
-            //Roc.setPosition(width / 2 + (Rocket.x - Sun.x - 1.5 * pow(10, 5) / 2 - X) * k + dMx, height / 2 + (Rocket.y - Sun.y - Y) * k + dMy);
-            Roc.setPosition(width / 2 + (Rocket.x - Sun.x - X) * k - 2.5f + dMx, height / 2 + (Rocket.y - Sun.y - Y) * k - 2.5f + dMy);
-            Roc.setFillColor(Color::Green);
-            //Roc.setRotation(-alpha * 180 / pi);
-            window.draw(Roc);
+    if (!ok || !(X == X))
+        return 0;
+
+    // Коэффициенты Лагранжа
+    double z = al * X * X, c = C(z), s = S(z);
+    double f = 1 - X * X / r0 * c;
+    double g = h - X * X * X / sm * s;
+
+    double nx = f * x + g * vx, ny = f * y + g * vy, r = norm(nx, ny);
+
+    double fd = sm / (r * r0) * X * (z * s - 1);
+    double gd = 1 - X * X / r * c;
+
+    double nvx = fd * x + gd * vx, nvy = fd * y + gd * vy;
+
+    x = nx;
+    y = ny;
+    vx = nvx;
+    vy = nvy;
+
+    return 1;
+}
+
+// Пояс астероидов из N тел на круговых орбитах от 2,2 до 3,3 а.е.
+void belt(Bodies& b, int N) {
+
+    // Астрономическая единица, м
+    const double au = 1.495978707 * pow(10, 11);
+
+    // Масса астероида, кг
+    const double Ma = pow(10, 16);
+
+    // Линейный конгруэнтный генератор для повторяемого пояса
+    unsigned long long q = 88172645463325252ULL;
+    auto rnd = [&q]() {
+        q = q * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (double)(q >> 11) / 9007199254740992.0;
+    };
+
+    for (int i = 0; i < N; i++) {
+        double r = (2.2 + 1.1 * rnd()) * au;
+        double f = 2 * pi * rnd();
+        double v = sqrt(G * b.M[SUN] / r);
+        b.add(Ma, 0, b.x[SUN] + r * sin(f), b.y[SUN] + r * cos(f), b.Vx[SUN] + v * cos(f), b.Vy[SUN] - v * sin(f), 1 << SUN, Color(128, 128, 128));
+    }
+}
+
+// Юлианская дата из строки ГГГГ-ММ-ДД или ГГГГ-ММ-ДДTчч:мм по григорианскому
+// календарю, 0 — строка не разобрана
+double julian(const char* s) {
 
+    int Y, Mo, D, hh = 0, mm = 0;
+    int k = sscanf(s, "%d-%d-%dT%d:%d", &Y, &Mo, &D, &hh, &mm);
+    if (k != 3 && k != 5)
+        return 0;
+    if (Mo < 1 || Mo > 12 || D < 1 || D > 31 || hh < 0 || hh > 23 || mm < 0 || mm > 59)
+        return 0;
+
+    int a = (14 - Mo) / 12;
+    int y = Y + 4800 - a;
+    int m = Mo + 12 * a - 3;
+    long jdn = D + (153 * m + 2) / 5 + 365L * y + y / 4 - y / 100 + y / 400 - 32045;
+
+    return jdn - 0.5 + (hh + mm / 60.0) / 24;
+}
+
+// Узлы первых nb тел миссии m от её начала до tk с шагом узлов h, с, в памяти;
+// между узлами тела идут схемой Иошиды по 10 шагов, без РН и прочих тел
+void Ephemeris::build(const Mission& m, int nb, double tk, double h) {
+
+    Bodies c;
+    for (int i = 0; i < nb; i++)
+        c.add(m.b.M[i], m.b.R[i], m.b.x[i], m.b.y[i], m.b.Vx[i], m.b.Vy[i], m.b.mk[i], m.b.C[i]);
+
+    hd = {};
+    memcpy(hd.tag, ephemTag, sizeof hd.tag);
+    hd.ver = ephemVer;
+    hd.nb = nb;
+    hd.jd = m.jd;
+    hd.t0 = m.t;
+    hd.h = h;
+    hd.ns = (int64_t)ceil(tk / h) + 1;
+
+    buf.resize(hd.ns * nb * 6);
+
+    const double w1 = 1 / (2 - cbrt(2.0));
+    const double w0 = 1 - 2 * w1;
+    const int ks = 10;
+    const double hs = h / ks;
+
+    auto drift = [&](double s) {
+        for (int i = 0; i < nb; i++) {
+            c.x[i] += c.Vx[i] * s;
+            c.y[i] += c.Vy[i] * s;
+        }
+    };
+    auto kick = [&](double s) {
+        gravity(c, m.gm, m.th);
+        for (int i = 0; i < nb; i++) {
+            c.Vx[i] += c.ax[i] * s;
+            c.Vy[i] += c.ay[i] * s;
+        }
+    };
+
+    for (int64_t k = 0; k < hd.ns; k++) {
+
+        gravity(c, m.gm, m.th);
+        for (int i = 0; i < nb; i++) {
+            double* r = &buf[(k * nb + i) * 6];
+            r[0] = c.x[i];
+            r[1] = c.y[i];
+            r[2] = c.Vx[i];
+            r[3] = c.Vy[i];
+            r[4] = c.ax[i];
+            r[5] = c.ay[i];
         }
 
-        window.display();
+        for (int j = 0; j < ks; j++) {
+            drift(w1 / 2 * hs);
+            kick(w1 * hs);
+            drift((w0 + w1) / 2 * hs);
+            kick(w0 * hs);
+            drift((w0 + w1) / 2 * hs);
+            kick(w1 * hs);
+            drift(w1 / 2 * hs);
+        }
     }
+
+    d = buf.data();
 }
 
-// Функция нормализации вектора
-double norm(double x, double y) {
-    return sqrt(pow(x, 2) + pow(y, 2));
+// Запись заголовка и узлов в файл fn
+bool Ephemeris::write(const char* fn) const {
+
+    std::ofstream fs(fn, std::ios::binary);
+    if (!fs)
+        return 0;
+
+    fs.write((const char*)&hd, sizeof hd);
+    fs.write((const char*)d, hd.ns * hd.nb * 6 * sizeof(double));
+
+    return (bool)fs;
 }
 
-// Функция перемножения векторов
-double dot(double x, double y, double Z[]) {
-    return x * Z[0] + y * Z[1];
+// Функция нормализации вектора
+double norm(double x, double y) {
+    return sqrt(x * x + y * y);
 }
 
 // Функция определения нахождения переменной в границах